@@ -0,0 +1,130 @@
+//
+// make_task; per-task construction cost of dsa::make_task and
+// dsa::task_system::push.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+// build: c++ -std=c++11 -O2 -pthread make_task.cpp -o make_task
+// usage: make_task [iterations]
+//
+// Each line reports the mean cost per task in nanoseconds; compare the output
+// of two builds to see the effect of a change.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../task.hpp"
+
+template <class F>
+static void report (std::string const & name, std::size_t n, F && f)
+{
+    /* warm up any pools and caches before timing */
+    f (n / 10 + 1);
+
+    auto const start = std::chrono::steady_clock::now ();
+    f (n);
+    auto const stop = std::chrono::steady_clock::now ();
+
+    auto const ns = std::chrono::duration_cast <std::chrono::nanoseconds> (
+        stop - start
+    ).count ();
+    std::cout << std::left << std::setw (40) << name
+              << std::right << std::setw (10) << std::fixed
+              << std::setprecision (1)
+              << static_cast <double> (ns) / static_cast <double> (n)
+              << " ns/task\n";
+}
+
+int main (int argc, char ** argv)
+{
+    std::size_t const n = argc > 1 ?
+        static_cast <std::size_t> (std::strtoull (argv [1], nullptr, 10)) :
+        1000000;
+
+    int x = 0;
+    int y = 0;
+
+    report ("make_task (std::allocator)", n, [&] (std::size_t k) {
+        for (std::size_t i = 0; i < k; ++i) {
+            auto t = dsa::make_task ([&x, &y] { return x + y; });
+            t.first ();
+            y += t.second.get ();
+        }
+    });
+
+    report ("make_task (pool_allocator)", n, [&] (std::size_t k) {
+        dsa::pool_allocator <dsa::task> alloc;
+        for (std::size_t i = 0; i < k; ++i) {
+            auto t = dsa::make_task (
+                std::allocator_arg, alloc, [&x, &y] { return x + y; }
+            );
+            t.first ();
+            y += t.second.get ();
+        }
+    });
+
+    report ("make_task, large closure", n, [&] (std::size_t k) {
+        dsa::pool_allocator <dsa::task> alloc;
+        std::string const s (100, 'x');
+        for (std::size_t i = 0; i < k; ++i) {
+            auto t = dsa::make_task (
+                std::allocator_arg, alloc,
+                [&x] (std::string const & str) {
+                    return x + static_cast <int> (str.size ());
+                },
+                s
+            );
+            t.first ();
+            y += t.second.get ();
+        }
+    });
+
+    std::size_t const nthreads = std::thread::hardware_concurrency ();
+    std::size_t const batch = 1024;
+
+    report ("task_system::push", n, [&] (std::size_t k) {
+        dsa::task_system <> pool {nthreads};
+        std::vector <std::future <int>> futures;
+        futures.reserve (batch);
+        for (std::size_t i = 0; i < k; i += batch) {
+            for (std::size_t j = 0; j < batch && i + j < k; ++j)
+                futures.emplace_back (pool.push ([&x] { return x; }));
+            for (auto & f : futures)
+                y += f.get ();
+            futures.clear ();
+        }
+    });
+
+    report ("task_system::post", n, [&] (std::size_t k) {
+        dsa::task_system <> pool {nthreads};
+        std::atomic_size_t count {0};
+        for (std::size_t i = 0; i < k; ++i)
+            pool.post ([&count] { count++; });
+        pool.done ();
+        pool.wait_to_completion ();
+    });
+
+    return y == -1;
+}
@@ -0,0 +1,343 @@
+//
+// scheduler; throughput, fork/join, stealing, and latency of
+// dsa::task_system, compared against a naive single-queue thread pool.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+// build: c++ -std=c++11 -O2 -pthread scheduler.cpp -o scheduler
+// usage: scheduler [scale [threads...]]
+//
+// Every case is run for each thread count (by default 1, 2, 4, ... up to the
+// hardware concurrency) on both pools, and reported on one line as
+//
+//      <case> <pool> <threads> <value> <unit>
+//
+// so that the output of two builds can be diffed or joined directly. scale
+// multiplies the amount of work in every case; the default is 1. Allocation
+// cost of dsa::make_task on its own is measured by make_task.cpp.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../task.hpp"
+
+/*
+ * naive_pool; the baseline. One mutex protected queue of std::function
+ * shared by every worker, which is what task_system improves on.
+ */
+class naive_pool
+{
+    std::deque <std::function <void (void)>> tasks_;
+    std::vector <std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable idle_;
+    std::size_t outstanding_ {0};
+    bool done_ {false};
+
+    void run (void)
+    {
+        while (true) {
+            std::function <void (void)> f;
+            {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                while (this->tasks_.empty () && !this->done_)
+                    this->ready_.wait (lock);
+                if (this->tasks_.empty ())
+                    return;
+                f = std::move (this->tasks_.front ());
+                this->tasks_.pop_front ();
+            }
+
+            f ();
+
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            if (--this->outstanding_ == 0)
+                this->idle_.notify_all ();
+        }
+    }
+
+public:
+    explicit naive_pool (std::size_t nthreads)
+    {
+        for (std::size_t th = 0; th < nthreads; ++th)
+            this->threads_.emplace_back (&naive_pool::run, this);
+    }
+
+    ~naive_pool (void)
+    {
+        {
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            this->done_ = true;
+        }
+        this->ready_.notify_all ();
+        for (auto & th : this->threads_)
+            th.join ();
+    }
+
+    template <class F>
+    void post (F && f)
+    {
+        {
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            this->tasks_.emplace_back (std::forward <F> (f));
+            this->outstanding_++;
+        }
+        this->ready_.notify_one ();
+    }
+
+    void wait_idle (void)
+    {
+        std::unique_lock <std::mutex> lock (this->mutex_);
+        while (this->outstanding_ != 0)
+            this->idle_.wait (lock);
+    }
+};
+
+using clock_type = std::chrono::steady_clock;
+
+static double elapsed_ns (clock_type::time_point start,
+                          clock_type::time_point stop)
+{
+    return static_cast <double> (
+        std::chrono::duration_cast <std::chrono::nanoseconds> (
+            stop - start
+        ).count ()
+    );
+}
+
+static void report (std::string const & name, std::string const & pool,
+                    std::size_t nthreads, double value,
+                    std::string const & unit)
+{
+    std::cout << std::left << std::setw (24) << name
+              << std::setw (8) << pool
+              << std::right << std::setw (4) << nthreads
+              << std::setw (14) << std::fixed << std::setprecision (1)
+              << value << ' ' << unit << '\n';
+}
+
+/*
+ * Empty tasks posted by producers outside the pool; reports the mean cost
+ * per task from the first post until the pool is idle again.
+ */
+template <class Pool>
+static double throughput (Pool & pool, std::size_t producers, std::size_t n)
+{
+    std::atomic_size_t count {0};
+    auto const start = clock_type::now ();
+
+    std::vector <std::thread> threads;
+    for (std::size_t p = 0; p < producers; ++p)
+        threads.emplace_back ([&pool, &count, n, producers] (void) {
+            for (std::size_t i = 0; i < n / producers; ++i)
+                pool.post ([&count] (void) {
+                    count.fetch_add (1, std::memory_order_relaxed);
+                });
+        });
+    for (auto & th : threads)
+        th.join ();
+    pool.wait_idle ();
+
+    return elapsed_ns (start, clock_type::now ()) /
+        static_cast <double> (count.load ());
+}
+
+/*
+ * Fork/join in the style of recursive fib: every call above the cutoff posts
+ * its two subcalls as tasks, and the leaves are added up.
+ */
+template <class Pool>
+struct fib_tree
+{
+    Pool & pool;
+    std::atomic <std::uint64_t> & sum;
+
+    void operator() (unsigned n) const
+    {
+        if (n < 2) {
+            this->sum.fetch_add (n, std::memory_order_relaxed);
+            return;
+        }
+
+        auto const self = *this;
+        this->pool.post ([self, n] (void) { self (n - 1); });
+        this->pool.post ([self, n] (void) { self (n - 2); });
+    }
+};
+
+template <class Pool>
+static double fib (Pool & pool, unsigned n)
+{
+    std::atomic <std::uint64_t> sum {0};
+    auto const start = clock_type::now ();
+    pool.post ([&pool, &sum, n] (void) {
+        fib_tree <Pool> {pool, sum} (n);
+    });
+    pool.wait_idle ();
+    return elapsed_ns (start, clock_type::now ()) / 1e6;
+}
+
+/*
+ * An unbalanced tree in the style of the UTS benchmark: each node's number
+ * of children is drawn from a hash of its identifier, so most subtrees are
+ * tiny and a few are very deep, and load has to be balanced by stealing.
+ */
+template <class Pool>
+struct unbalanced_tree
+{
+    Pool & pool;
+    std::atomic <std::uint64_t> & nodes;
+
+    static std::uint64_t mix (std::uint64_t x) noexcept
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    void operator() (std::uint64_t id, unsigned depth) const
+    {
+        this->nodes.fetch_add (1, std::memory_order_relaxed);
+
+        /* roughly a binomial tree: 8 children with probability 1/8 */
+        auto const h = mix (id);
+        auto const children = depth == 0 || h % 8 != 0 ? 0u : 8u;
+
+        /* a little work per node, so that it is not all queue traffic */
+        volatile std::uint64_t x = h;
+        for (int k = 0; k < 64; ++k)
+            x = mix (x);
+
+        auto const self = *this;
+        for (unsigned c = 0; c < children; ++c) {
+            auto const child = h + c + 1;
+            this->pool.post ([self, child, depth] (void) {
+                self (child, depth - 1);
+            });
+        }
+    }
+};
+
+template <class Pool>
+static double unbalanced (Pool & pool, std::size_t roots, unsigned depth)
+{
+    std::atomic <std::uint64_t> nodes {0};
+    auto const start = clock_type::now ();
+    for (std::size_t r = 0; r < roots; ++r)
+        pool.post ([&pool, &nodes, r, depth] (void) {
+            unbalanced_tree <Pool> {pool, nodes} (r * 0x9e3779b97f4a7c15ull,
+                                                  depth);
+        });
+    pool.wait_idle ();
+    return elapsed_ns (start, clock_type::now ()) /
+        static_cast <double> (nodes.load ());
+}
+
+/*
+ * A single task posted to an idle pool at a time; reports the median and
+ * 99th percentile time in nanoseconds from post until it starts running.
+ */
+template <class Pool>
+static std::pair <double, double> latency (Pool & pool, std::size_t n)
+{
+    std::vector <double> samples;
+    samples.reserve (n);
+    for (std::size_t i = 0; i < n; ++i) {
+        std::atomic <clock_type::rep> started {0};
+        auto const start = clock_type::now ();
+        pool.post ([&started] (void) {
+            started.store (clock_type::now ().time_since_epoch ().count ());
+        });
+        pool.wait_idle ();
+        samples.push_back (elapsed_ns (
+            start,
+            clock_type::time_point (clock_type::duration (started.load ()))
+        ));
+
+        /* let the workers go back to sleep between samples */
+        if (i % 16 == 0)
+            std::this_thread::sleep_for (std::chrono::microseconds {200});
+    }
+
+    std::sort (samples.begin (), samples.end ());
+    return std::make_pair (samples [n / 2], samples [n * 99 / 100]);
+}
+
+template <class Pool>
+static void run_cases (std::string const & pool_name, std::size_t nthreads,
+                       std::size_t scale)
+{
+    Pool pool {nthreads};
+    std::size_t const producers = std::max <std::size_t> (2, nthreads);
+
+    report ("post, 1 producer", pool_name, nthreads,
+            throughput (pool, 1, 200000 * scale), "ns/task");
+    report ("post, n producers", pool_name, nthreads,
+            throughput (pool, producers, 200000 * scale), "ns/task");
+    report ("fib (24)", pool_name, nthreads,
+            fib (pool, 24 + static_cast <unsigned> (scale) - 1), "ms");
+    report ("unbalanced tree", pool_name, nthreads,
+            unbalanced (pool, 4096 * scale, 64), "ns/node");
+
+    auto const l = latency (pool, 2000);
+    report ("post to start, p50", pool_name, nthreads, l.first, "ns");
+    report ("post to start, p99", pool_name, nthreads, l.second, "ns");
+}
+
+int main (int argc, char ** argv)
+{
+    std::size_t const scale = argc > 1 ?
+        std::max <std::size_t> (
+            1, static_cast <std::size_t> (std::strtoull (argv [1], nullptr, 10))
+        ) : 1;
+
+    std::vector <std::size_t> counts;
+    for (int a = 2; a < argc; ++a)
+        counts.push_back (
+            static_cast <std::size_t> (std::strtoull (argv [a], nullptr, 10))
+        );
+    if (counts.empty ()) {
+        std::size_t const hw =
+            std::max <unsigned> (1, std::thread::hardware_concurrency ());
+        for (std::size_t n = 1; n < hw; n *= 2)
+            counts.push_back (n);
+        counts.push_back (hw);
+    }
+
+    for (auto n : counts) {
+        run_cases <dsa::task_system <>> ("dsa", n, scale);
+        run_cases <naive_pool> ("naive", n, scale);
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+//
+// dsa is a utility library of data structures and algorithms built with C++11.
+// This file (blocking.hpp) is part of the dsa project.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+
+#ifndef DSA_BLOCKING_HPP
+#define DSA_BLOCKING_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "task.hpp"
+#include "future.hpp"
+
+
+namespace dsa
+{
+    /*
+     * blocking_executor; a companion to a compute task_system for calls that
+     * block, such as file or network reads. Tasks of a task_system are
+     * assumed not to block, so a worker stalled on a slow disk is simply
+     * lost to the pool; here, blocking calls get threads of their own.
+     *
+     * The threads form an elastic task_system: one is kept, another is
+     * started whenever a call is submitted while none is idle, up to
+     * max_threads, and each beyond the first exits after idle_timeout
+     * without work. Idle threads park at once rather than spin.
+     *
+     * submit runs the call here and returns a dsa::future of its result
+     * whose continuations run on the compute task_system, so that the work
+     * done with the result does not occupy a blocking thread:
+     *
+     *      dsa::blocking_executor <> io;
+     *      auto f = io.submit (compute, read_file, path)
+     *          .then ([] (std::vector <char> contents) { ... });
+     */
+    template <class Allocator = pool_allocator <task>>
+    class blocking_executor
+    {
+        task_system <Allocator> pool_;
+
+    public:
+        explicit blocking_executor (
+            std::size_t max_threads = 64,
+            std::chrono::milliseconds idle_timeout = std::chrono::seconds {10},
+            Allocator const & alloc = Allocator ())
+            : pool_ {resize_policy {1, max_threads, idle_timeout, 0},
+                     alloc, idle_policy::low_power ()}
+        {}
+
+        blocking_executor (blocking_executor const &) = delete;
+        blocking_executor & operator= (blocking_executor const &) = delete;
+
+        /*
+         * Runs f (args...) on a blocking thread; continuations of the
+         * returned future are scheduled on system. Arguments are decay-copied
+         * as for task_system::push.
+         */
+        template <class System, class F, class ... Args>
+        future <detail::task_result_t <F, Args...>>
+            submit (System & system, F && f, Args && ... args)
+        {
+            using result_type = detail::task_result_t <F, Args...>;
+            using call_type = detail::async_call <
+                result_type, typename std::decay <F>::type
+            >;
+
+            auto dst = std::make_shared <detail::future_state <result_type>> (
+                detail::executor::of (system)
+            );
+            this->pool_.post (call_type {dst, std::forward <F> (f)},
+                              std::forward <Args> (args)...);
+            return detail::future_access::make (std::move (dst));
+        }
+
+        /*
+         * Fire-and-forget; as task_system::post, on a blocking thread.
+         */
+        template <class F, class ... Args>
+        void post (F && f, Args && ... args)
+        {
+            this->pool_.post (
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+        }
+
+        /*
+         * Waits until every submitted call has finished; their continuations
+         * have then been pushed to their task_system, but may not have run.
+         */
+        void wait_idle (void)
+        {
+            this->pool_.wait_idle ();
+        }
+
+        /*
+         * The number of blocking threads currently running, and the most
+         * there can be.
+         */
+        std::size_t size (void) const noexcept
+        {
+            return this->pool_.size ();
+        }
+
+        std::size_t capacity (void) const noexcept
+        {
+            return this->pool_.capacity ();
+        }
+    };
+}   // namespace dsa
+
+#endif  // #ifndef DSA_BLOCKING_HPP
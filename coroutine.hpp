@@ -0,0 +1,368 @@
+//
+// dsa is a utility library of data structures and algorithms built with C++11.
+// This file (coroutine.hpp) is part of the dsa project.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+
+#ifndef DSA_COROUTINE_HPP
+#define DSA_COROUTINE_HPP
+
+#include "task.hpp"
+#include "future.hpp"
+
+/*
+ * Everything here requires C++20 coroutines; with an older compiler or
+ * language mode this header is empty (see DSA_TASK_COROUTINES).
+ */
+#ifdef DSA_TASK_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace dsa
+{
+    template <class T>
+    class co_task;
+
+namespace detail
+{
+    /*
+     * Coroutine frames are allocated from the same per-thread pools as
+     * tasks; see pool_allocator.
+     */
+    struct pooled_frame
+    {
+        static void * operator new (std::size_t n)
+        {
+            return pool_allocator <unsigned char> {}.allocate (n);
+        }
+
+        static void operator delete (void * p, std::size_t n) noexcept
+        {
+            pool_allocator <unsigned char> {}.deallocate (
+                static_cast <unsigned char *> (p), n
+            );
+        }
+    };
+
+    /*
+     * co_promise_base; a co_task starts suspended and runs only once it is
+     * awaited. When it finishes, control transfers straight to the awaiting
+     * coroutine, without going through the scheduler.
+     */
+    struct co_promise_base : pooled_frame
+    {
+        std::coroutine_handle <> continuation;
+        std::exception_ptr error;
+
+        struct final_awaiter
+        {
+            bool await_ready (void) const noexcept
+            {
+                return false;
+            }
+
+            template <class Promise>
+            std::coroutine_handle <>
+                await_suspend (std::coroutine_handle <Promise> h) noexcept
+            {
+                auto const c = h.promise ().continuation;
+                return c ? c : std::noop_coroutine ();
+            }
+
+            void await_resume (void) const noexcept
+            {}
+        };
+
+        std::suspend_always initial_suspend (void) const noexcept
+        {
+            return {};
+        }
+
+        final_awaiter final_suspend (void) const noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception (void) noexcept
+        {
+            this->error = std::current_exception ();
+        }
+    };
+
+    template <class T>
+    struct co_promise : co_promise_base
+    {
+        union { T value; };
+        bool has_value {false};
+
+        co_promise (void) noexcept
+        {}
+
+        ~co_promise (void)
+        {
+            if (this->has_value)
+                this->value.~T ();
+        }
+
+        co_task <T> get_return_object (void) noexcept;
+
+        template <class U>
+        void return_value (U && u)
+        {
+            ::new (static_cast <void *> (std::addressof (this->value)))
+                T (std::forward <U> (u));
+            this->has_value = true;
+        }
+
+        T result (void)
+        {
+            if (this->error)
+                std::rethrow_exception (this->error);
+            return std::move (this->value);
+        }
+    };
+
+    template <>
+    struct co_promise <void> : co_promise_base
+    {
+        co_task <void> get_return_object (void) noexcept;
+
+        void return_void (void) noexcept
+        {}
+
+        void result (void)
+        {
+            if (this->error)
+                std::rethrow_exception (this->error);
+        }
+    };
+
+    /*
+     * The return type of coroutines that nobody awaits; the frame runs
+     * eagerly and frees itself when it finishes.
+     */
+    struct detached_coroutine
+    {
+        struct promise_type : pooled_frame
+        {
+            detached_coroutine get_return_object (void) const noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never initial_suspend (void) const noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never final_suspend (void) const noexcept
+            {
+                return {};
+            }
+
+            void return_void (void) const noexcept
+            {}
+
+            void unhandled_exception (void) const noexcept
+            {
+                std::terminate ();
+            }
+        };
+    };
+
+    template <class System, class T>
+    detached_coroutine run_spawned (System & system, co_task <T> t,
+                                    std::shared_ptr <future_state <T>> dst)
+    {
+        co_await system.schedule ();
+        try {
+            if constexpr (std::is_void <T>::value) {
+                co_await std::move (t);
+            } else {
+                dst->emplace (co_await std::move (t));
+            }
+        } catch (...) {
+            dst->error = std::current_exception ();
+        }
+        dst->complete ();
+    }
+
+    template <class T>
+    struct future_awaiter
+    {
+        std::shared_ptr <future_state <T>> state;
+
+        bool await_ready (void) const
+        {
+            return this->state->is_ready ();
+        }
+
+        void await_suspend (std::coroutine_handle <> h)
+        {
+            this->state->on_ready (task_access::make_detached (
+                [h] (void) { h.resume (); }
+            ));
+        }
+
+        T await_resume (void)
+        {
+            return this->state->take ();
+        }
+    };
+}   // namespace detail
+
+    /*
+     * co_task; the return type of coroutines that run on a task_system.
+     * Like a function call, a co_task runs when it is awaited, on the
+     * awaiting thread, and resumes the awaiting coroutine when it finishes.
+     * It moves to a worker with co_await system.schedule (). Exceptions
+     * propagate to the awaiter. To start a chain of coroutines from ordinary
+     * code, pass the outermost one to dsa::spawn.
+     *
+     * co_task is move-only and can be awaited once.
+     */
+    template <class T>
+    class co_task
+    {
+    public:
+        using promise_type = detail::co_promise <T>;
+        using handle_type = std::coroutine_handle <promise_type>;
+
+    private:
+        handle_type handle_;
+
+        struct awaiter
+        {
+            handle_type handle;
+
+            bool await_ready (void) const noexcept
+            {
+                return this->handle.done ();
+            }
+
+            std::coroutine_handle <>
+                await_suspend (std::coroutine_handle <> awaiting) noexcept
+            {
+                this->handle.promise ().continuation = awaiting;
+                return this->handle;
+            }
+
+            T await_resume (void)
+            {
+                return this->handle.promise ().result ();
+            }
+        };
+
+    public:
+        co_task (void) noexcept
+            : handle_ {}
+        {}
+
+        explicit co_task (handle_type h) noexcept
+            : handle_ {h}
+        {}
+
+        co_task (co_task const &) = delete;
+        co_task & operator= (co_task const &) = delete;
+
+        co_task (co_task && other) noexcept
+            : handle_ {std::exchange (other.handle_, {})}
+        {}
+
+        co_task & operator= (co_task && other) noexcept
+        {
+            if (this != &other) {
+                if (this->handle_)
+                    this->handle_.destroy ();
+                this->handle_ = std::exchange (other.handle_, {});
+            }
+            return *this;
+        }
+
+        ~co_task (void)
+        {
+            if (this->handle_)
+                this->handle_.destroy ();
+        }
+
+        bool valid (void) const noexcept
+        {
+            return static_cast <bool> (this->handle_);
+        }
+
+        awaiter operator co_await (void) && noexcept
+        {
+            return awaiter {this->handle_};
+        }
+    };
+
+namespace detail
+{
+    template <class T>
+    co_task <T> co_promise <T>::get_return_object (void) noexcept
+    {
+        return co_task <T> (
+            std::coroutine_handle <co_promise>::from_promise (*this)
+        );
+    }
+
+    inline co_task <void> co_promise <void>::get_return_object (void) noexcept
+    {
+        return co_task <void> (
+            std::coroutine_handle <co_promise>::from_promise (*this)
+        );
+    }
+}   // namespace detail
+
+    /*
+     * spawn; starts t on one of system's workers and returns a future of
+     * its result, which can in turn be chained with then or awaited.
+     */
+    template <class System, class T>
+    future <T> spawn (System & system, co_task <T> t)
+    {
+        auto dst = std::make_shared <detail::future_state <T>> (
+            detail::executor::of (system)
+        );
+        detail::run_spawned (system, std::move (t), dst);
+        return detail::future_access::make (std::move (dst));
+    }
+
+    /*
+     * Makes the futures of dsa::async (and of then, when_all, and when_any)
+     * awaitable. The awaiting coroutine is resumed on a worker of the
+     * future's task_system once the value is ready, and the future is
+     * consumed as by get.
+     */
+    template <class T>
+    detail::future_awaiter <T> operator co_await (future <T> f)
+    {
+        auto s = detail::future_access::state (f);
+        return detail::future_awaiter <T> {std::move (s)};
+    }
+}   // namespace dsa
+
+#endif  // #ifdef DSA_TASK_COROUTINES
+
+#endif  // #ifndef DSA_COROUTINE_HPP
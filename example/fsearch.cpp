@@ -18,18 +18,33 @@
 //
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <mutex>
+#include <sstream>
 #include <regex>
 #include <stdexcept>
 #include <string>
+#include <system_error>
 #include <utility>
+#include <tuple>
 #include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include "matcher.hpp"
+#include "../future.hpp"
+#include "../io.hpp"
+#include "../parallel.hpp"
 #include "../task.hpp"
 
 namespace bfs = boost::filesystem;
@@ -39,15 +54,17 @@ struct context
 {
     bfs::path search_path;
     std::vector <std::string> matcher_strings;
-    std::vector <std::regex> matchers;
+    matcher::pattern_set matchers;
     std::string filter_string;
     std::regex filter;
     std::string syntax;
+    std::string engine;
     std::size_t num_threads;
     bool help;
     bool use_file;
     bool print_matches;
     bool print_files;
+    bool use_mmap;
     bool verbose;
 };
 
@@ -96,6 +113,12 @@ static context parse_args (int argc, char ** argv)
          bpo::value <std::string> ()->default_value ("ECMAScript"),
          "the match regex syntax; available syntaxes are ECMAScript, posix,"
          " eposix (extended POSIX), awk, grep, and egrep (extended grep).")
+        ("engine,e",
+         bpo::value <std::string> ()->default_value ("std"),
+         "the match engine; std (std::regex) or dfa (a deterministic"
+         " automaton for a subset of ECMAScript, reporting the longest match"
+         " at each position); either way, lines without a literal that the"
+         " regex requires are skipped")
         ("threads,t",
          bpo::value <std::size_t> ()
             ->default_value (std::thread::hardware_concurrency ()),
@@ -106,6 +129,9 @@ static context parse_args (int argc, char ** argv)
         ("suppress-files,F",
          "output only the matches found (i.e., do not list each file where a"
          " match was found)")
+        ("mmap,m",
+         "scan files in place through read-only memory maps rather than"
+         " reading them into buffers first")
         ("verbose,v", "run in verbose mode");
 
     bpo::variables_map vars;
@@ -129,11 +155,13 @@ static context parse_args (int argc, char ** argv)
     c.matcher_strings = vars ["search"].as <std::vector <std::string>> ();
     c.filter_string = vars ["filter"].as <std::string> ();
     c.syntax = vars ["syntax"].as <std::string> ();
+    c.engine = vars ["engine"].as <std::string> ();
     c.num_threads = vars ["threads"].as <std::size_t> ();
     c.help  = vars.count ("help") != 0;
     c.use_file = vars.count ("use-file") != 0;
     c.print_matches = vars.count ("suppress-matches") == 0;
     c.print_files = vars.count ("suppress-files") == 0;
+    c.use_mmap = vars.count ("mmap") != 0;
     c.verbose = vars.count ("verbose") != 0;
 
     if (!bfs::is_directory (c.search_path)) {
@@ -157,8 +185,17 @@ static context parse_args (int argc, char ** argv)
             << "]\n"
             << opdesc;
         throw std::runtime_error (err.str ());
+    } else if (c.engine != "std" && c.engine != "dfa") {
+        std::ostringstream err;
+        err << "input error -- unrecognized match engine ["
+            << c.engine
+            << "]\n"
+            << opdesc;
+        throw std::runtime_error (err.str ());
     }
 
+    auto const engine = c.engine == "dfa" ?
+        matcher::engine::dfa : matcher::engine::std_regex;
     auto const regex_syntax = syntaxes.at (c.syntax);
     c.filter = std::regex {
         c.filter_string.empty () ?
@@ -166,6 +203,7 @@ static context parse_args (int argc, char ** argv)
         regex_syntax
     };
 
+    std::vector <std::string> patterns;
     if (c.use_file) {
         for (auto const & f : c.matcher_strings) {
             if (!bfs::is_regular_file (bfs::path (f))) {
@@ -179,110 +217,546 @@ static context parse_args (int argc, char ** argv)
             std::ifstream regex_file (f);
             std::string line;
             while (std::getline (regex_file, line) && !line.empty ()) {
-                c.matchers.emplace_back (line, regex_syntax);
+                patterns.push_back (line);
             }
         }
     } else {
-        for (auto const & s : c.matcher_strings) {
-            c.matchers.emplace_back (s, regex_syntax);
-        }
+        patterns = c.matcher_strings;
     }
 
-    if (c.matchers.empty ()) {
+    if (patterns.empty ()) {
         std::ostringstream err;
         err << "input error -- no provided search regex\n"
             << opdesc;
         throw std::runtime_error (err.str ());
     }
 
+    c.matchers = matcher::pattern_set {patterns, regex_syntax, engine};
     return c;
 }
 
-static std::tuple <
-    std::map <
-        std::string, std::future <std::pair <bool, std::vector <std::string>>>
-    >,
-    std::size_t,
-    std::size_t,
-    std::size_t
-> perform_search (context const & cntx)
+using match_result = std::pair <bool, std::vector <std::string>>;
+using found_list = std::vector <std::pair <std::size_t, std::string>>;
+
+/*
+ * Files are searched in pieces of at least this size, split after a newline,
+ * when the patterns only match within lines; see find_matches.
+ */
+static constexpr std::size_t min_chunk_size = 1024 * 1024;
+
+/*
+ * Unless at_end, an empty match at last is left to the search that resumes
+ * there, which also decides whether there is one.
+ */
+static void find_in (context const & cntx, char const * first,
+                     char const * last, found_list & found,
+                     bool at_end = true)
 {
-    dsa::task_system <> work_pool {cntx.num_threads};
-    std::map <
-        std::string, std::future <std::pair <bool, std::vector <std::string>>>
-    > results;
-    std::size_t dirs_searched {0};
-    std::size_t files_searched {0};
+    cntx.matchers.find_all (first, last,
+        [&found, last, at_end] (std::size_t i, char const * b,
+                                char const * e) {
+            if (at_end || b != last)
+                found.emplace_back (i, std::string (b, e));
+        }
+    );
+}
+
+/*
+ * The boundaries of the pieces that [first, last) is searched in: about
+ * four for each worker, so that they balance with the work of other files,
+ * but none smaller than min_chunk_size, and each but the last ending just
+ * after a newline.
+ */
+static std::vector <char const *> split_lines (context const & cntx,
+                                               char const * first,
+                                               char const * last)
+{
+    auto const size = static_cast <std::size_t> (last - first);
+    auto const pieces = std::min (size / min_chunk_size,
+                                  4 * cntx.num_threads);
+    std::vector <char const *> bounds {first};
+
+    auto const chunk = pieces < 2 ? size : size / pieces;
+    for (std::size_t k = 1; k < pieces; ++k) {
+        auto const from = std::max (bounds.back (), first + k * chunk);
+        if (from >= last)
+            break;
+        auto const eol = static_cast <char const *> (
+            std::memchr (from, '\n', static_cast <std::size_t> (last - from))
+        );
+        if (!eol || eol + 1 == last)
+            break;
+        bounds.push_back (eol + 1);
+    }
+    bounds.push_back (last);
+    return bounds;
+}
+
+/*
+ * Called on one of work_pool's workers. When every pattern matches within
+ * lines, a large buffer is split after newlines into pieces searched in
+ * parallel, which lose no match and report none twice since no match can
+ * cross a split; the pieces' matches are then put back in offset order.
+ */
+static match_result find_matches (context const & cntx,
+                                  dsa::task_system <> & work_pool,
+                                  char const * first, char const * last)
+{
+    found_list found;
+    auto const bounds = cntx.matchers.line_local () ?
+        split_lines (cntx, first, last) :
+        std::vector <char const *> {first, last};
+
+    if (bounds.size () == 2) {
+        find_in (cntx, first, last, found);
+    } else {
+        std::vector <found_list> pieces (bounds.size () - 1);
+        dsa::task_group <> group {work_pool};
+        for (std::size_t k = 1; k < pieces.size (); ++k)
+            group.run ([&cntx, &bounds, &pieces, k] (void) {
+                find_in (cntx, bounds [k], bounds [k + 1], pieces [k],
+                         k + 1 == pieces.size ());
+            });
+        find_in (cntx, bounds [0], bounds [1], pieces [0], false);
+        group.wait ();
+
+        for (auto & p : pieces)
+            std::move (p.begin (), p.end (), std::back_inserter (found));
+    }
+
+    /*
+     * The patterns are matched together, in one pass where possible; the
+     * results are listed pattern by pattern, as if each were searched for
+     * in turn.
+     */
+    std::stable_sort (
+        found.begin (), found.end (),
+        [] (std::pair <std::size_t, std::string> const & a,
+            std::pair <std::size_t, std::string> const & b) {
+            return a.first < b.first;
+        }
+    );
+
+    std::vector <std::string> results;
+    results.reserve (found.size ());
+    for (auto & f : found)
+        results.push_back (std::move (f.second));
+
+    auto const match = !results.empty ();
+    return std::make_pair (match, std::move (results));
+}
+
+/*
+ * Files no larger than this are copied into a buffer kept by each worker
+ * when scanning in place, since mapping and unmapping them would cost more
+ * than the copy does.
+ */
+static constexpr std::size_t small_file_size = 64 * 1024;
+
+struct file_descriptor
+{
+    int fd;
+
+    ~file_descriptor (void)
+    {
+        if (this->fd >= 0)
+            ::close (this->fd);
+    }
+};
+
+static std::system_error read_error (std::string const & path)
+{
+    return std::system_error (
+        errno, std::system_category (), "failed to read file " + path
+    );
+}
+
+/*
+ * The --mmap mode; scans the file at path where it lies, in a memory map
+ * or, when it is small, in this worker's buffer.
+ */
+static match_result scan_in_place (context const & cntx,
+                                   dsa::task_system <> & work_pool,
+                                   std::string const & path,
+                                   std::atomic_size_t & bytes_read)
+{
+    file_descriptor const file {::open (path.c_str (), O_RDONLY | O_CLOEXEC)};
+    struct ::stat st;
+    if (file.fd < 0 || ::fstat (file.fd, &st) != 0)
+        throw read_error (path);
+
+    auto const size = static_cast <std::size_t> (st.st_size);
+    if (size > small_file_size) {
+        dsa::mapped_file const map {file.fd, size};
+        bytes_read += map.size ();
+        return find_matches (cntx, work_pool, map.begin (), map.end ());
+    }
+
+    thread_local std::vector <char> buffer (small_file_size);
+    std::size_t done = 0;
+    while (done < size) {
+        auto const n = ::read (file.fd, buffer.data () + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw read_error (path);
+        if (n == 0)
+            break;
+        done += static_cast <std::size_t> (n);
+    }
+
+    bytes_read += done;
+    return find_matches (cntx, work_pool, buffer.data (),
+                         buffer.data () + done);
+}
+
+/*
+ * output_buffer; the results on their way from the workers to the thread
+ * that prints them, as a lock-free intrusive multi-producer single-consumer
+ * queue (after Vyukov). Pushing never blocks; the consumer sleeps on a
+ * condition variable only when the queue is empty, and producers take the
+ * mutex only to wake it.
+ */
+class output_buffer
+{
+public:
+    struct node
+    {
+        std::atomic <node *> next {nullptr};
+        std::string text;
+        bool error;
+    };
+
+private:
+    std::atomic <node *> head_;
+    node * tail_;
+    node stub_;
+    std::atomic_bool waiting_ {false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    /*
+     * The exchange is sequentially consistent, as are the accesses to
+     * waiting_, so that a producer which then finds waiting_ unset is one
+     * whose node the consumer is bound to see in wait.
+     */
+    void link (node * n) noexcept
+    {
+        n->next.store (nullptr, std::memory_order_relaxed);
+        auto const prev = this->head_.exchange (n);
+        prev->next.store (n, std::memory_order_release);
+    }
+
+    /*
+     * Consumer only, once pop has returned nullptr.
+     */
+    bool empty (void) const noexcept
+    {
+        return this->tail_->next.load () == nullptr &&
+            this->head_.load () == this->tail_;
+    }
+
+public:
+    output_buffer (void)
+        : head_ {&this->stub_}
+        , tail_ {&this->stub_}
+    {}
+
+    ~output_buffer (void)
+    {
+        while (auto const n = this->pop ())
+            delete n;
+    }
+
+    void push (std::string text, bool error)
+    {
+        auto const n = new node;
+        n->text = std::move (text);
+        n->error = error;
+        this->link (n);
+        this->notify ();
+    }
+
+    /*
+     * Wakes the consumer if it is waiting. Whatever the caller changed
+     * beforehand, with a sequentially consistent store or read-modify-write,
+     * is seen by the consumer either way.
+     */
+    void notify (void)
+    {
+        if (this->waiting_.load ()) {
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            this->cv_.notify_one ();
+        }
+    }
+
+    /*
+     * The oldest node, which the caller then owns, or nullptr if there is
+     * none yet; consumer only.
+     */
+    node * pop (void) noexcept
+    {
+        auto tail = this->tail_;
+        auto next = tail->next.load (std::memory_order_acquire);
+        if (tail == &this->stub_) {
+            if (!next)
+                return nullptr;
+            this->tail_ = tail = next;
+            next = next->next.load (std::memory_order_acquire);
+        }
+
+        if (next) {
+            this->tail_ = next;
+            return tail;
+        }
+
+        /* a producer is between its exchange and its link */
+        if (tail != this->head_.load (std::memory_order_acquire))
+            return nullptr;
+
+        this->link (&this->stub_);
+        next = tail->next.load (std::memory_order_acquire);
+        if (next) {
+            this->tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    /*
+     * Waits until something has been pushed or ready () holds, where ready
+     * reads state that is changed before a call to notify; consumer only.
+     */
+    template <class Predicate>
+    void wait (Predicate ready)
+    {
+        std::unique_lock <std::mutex> lock (this->mutex_);
+        this->waiting_.store (true);
+        while (!ready () && this->empty ())
+            this->cv_.wait (lock);
+        this->waiting_.store (false);
+    }
+};
+
+static std::string format_result (context const & cntx,
+                                  std::string const & name,
+                                  match_result const & result)
+{
+    std::ostringstream out;
+    if (result.first) {
+        if (cntx.print_files && cntx.print_matches) {
+            for (auto const & m : result.second)
+                out << name << ':' << m << '\n';
+        } else if (cntx.print_files) {
+            out << name;
+        } else if (cntx.print_matches) {
+            for (auto const & m : result.second)
+                out << m << '\n';
+        }
+    }
+    return out.str ();
+}
+
+/*
+ * searcher; a search in progress. Directories are listed by tasks on the
+ * work pool, each of which pushes a task for every subdirectory and starts
+ * a read for every file, using the type that readdir reports to avoid
+ * stat calls. Each file's results go to the output buffer as soon as it
+ * has been matched.
+ */
+class searcher
+{
+    context const & cntx_;
+    dsa::task_system <> & work_pool_;
+    dsa::file_reader & reader_;
+    output_buffer & output_;
+
+    /* the directories and files whose search has not yet finished */
+    std::atomic_size_t outstanding_ {0};
+
+public:
+    std::atomic_size_t dirs_searched {0};
+    std::atomic_size_t files_searched {0};
     std::atomic_size_t bytes_read {0};
 
-    auto find_matches =
-    [&cntx, &results, &bytes_read] (bfs::path const & filepath)
-        -> std::pair <bool, std::vector <std::string>>
+    searcher (context const & cntx, dsa::task_system <> & work_pool,
+              dsa::file_reader & reader, output_buffer & output)
+        : cntx_ (cntx)
+        , work_pool_ (work_pool)
+        , reader_ (reader)
+        , output_ (output)
+    {}
+
+    bool finished (void) const noexcept
+    {
+        return this->outstanding_.load () == 0;
+    }
+
+    void start (std::string root)
+    {
+        this->outstanding_++;
+        this->work_pool_.post ([this, root] (void) { this->list (root); });
+    }
+
+private:
+    void finish (void)
+    {
+        if (--this->outstanding_ == 0)
+            this->output_.notify ();
+    }
+
+    void report (std::string const & name, match_result const & result)
+    {
+        auto text = format_result (this->cntx_, name, result);
+        if (!text.empty ())
+            this->output_.push (std::move (text), false);
+    }
+
+    void fail (std::string const & what)
     {
-        static auto read_file =
-        [] (bfs::path const & filepath, std::vector <char> & buf)
-            -> bool
-        {
-            std::ifstream fs (
-                filepath.string (),
-                std::ios::binary|std::ios::ate
-            );
-            auto const size = fs.tellg ();
-            fs.seekg (0, std::ios::beg);
-            buf.resize (size, ' ');
-            fs.read (buf.data (), size);
-            return fs.good ();
-        };
-
-        std::vector <char> contents;
-        if (read_file (filepath, contents)) {
-            bytes_read += contents.size ();
-            std::vector <std::string> results;
-
-            for (auto const & m : cntx.matchers) {
-                auto const begin = std::cregex_iterator {
-                    contents.data (),
-                    contents.data () + contents.size (),
-                    m
-                };
-                auto const end = std::cregex_iterator {};
-                for (auto it = begin; it != end; ++it)
-                    results.emplace_back ((*it) [0]);
+        this->output_.push ("[[exception: " + what + "]]\n", true);
+    }
+
+    void list (std::string const & dir)
+    {
+        auto const d = ::opendir (dir.c_str ());
+        if (!d) {
+            this->fail (std::system_error (
+                errno, std::system_category (),
+                "failed to open directory " + dir
+            ).what ());
+            this->finish ();
+            return;
+        }
+
+        auto const prefix = !dir.empty () && dir.back () == '/' ?
+            dir : dir + '/';
+        while (auto const e = ::readdir (d)) {
+            if (std::strcmp (e->d_name, ".") == 0 ||
+                std::strcmp (e->d_name, "..") == 0)
+                continue;
+
+            bool is_dir = e->d_type == DT_DIR;
+            bool is_file = e->d_type == DT_REG;
+            bool is_link = e->d_type == DT_LNK;
+            if (e->d_type == DT_UNKNOWN || is_link) {
+                /*
+                 * Links are followed to decide what they are, but like
+                 * recursive_directory_iterator, not walked into.
+                 */
+                struct ::stat st;
+                if (!is_link && ::fstatat (::dirfd (d), e->d_name, &st,
+                                           AT_SYMLINK_NOFOLLOW) == 0)
+                    is_link = S_ISLNK (st.st_mode);
+                if (::fstatat (::dirfd (d), e->d_name, &st, 0) != 0)
+                    continue;
+                is_dir = S_ISDIR (st.st_mode);
+                is_file = S_ISREG (st.st_mode);
             }
 
-            auto const match = !results.empty ();
-            return std::make_pair (match, std::move (results));
-        } else {
-            throw std::runtime_error (
-                "failed to read file " + filepath.string ()
-            );
+            auto path = prefix + e->d_name;
+            if (is_dir) {
+                this->dirs_searched++;
+                if (!is_link)
+                    this->start (std::move (path));
+            } else if (is_file &&
+                       std::regex_search (path, this->cntx_.filter)) {
+                this->files_searched++;
+                this->search_file (std::move (path));
+            }
         }
-    };
 
-    for (auto && e : bfs::recursive_directory_iterator (cntx.search_path)) {
-        auto && path = bfs::path (e.path ());
-        if (bfs::exists (path)) {
-            auto && name = std::string (path.string ());
-            if (!bfs::is_directory (e) &&
-                std::regex_search (name, cntx.filter))
-            {
-                files_searched++;
-                results.emplace (
-                    std::move (name),
-                    work_pool.push (find_matches, std::move (path))
-                );
-            } else if (bfs::is_directory (e)) {
-                dirs_searched++;
+        ::closedir (d);
+        this->finish ();
+    }
+
+    /*
+     * Files are read asynchronously, through io_uring where the kernel has
+     * it, and matched on the work pool as each read completes; with --mmap,
+     * a task on the work pool maps each file and matches it in place.
+     */
+    void search_file (std::string path)
+    {
+        this->outstanding_++;
+
+        if (this->cntx_.use_mmap) {
+            this->work_pool_.post ([this, path] (void) {
+                try {
+                    this->report (path, scan_in_place (
+                        this->cntx_, this->work_pool_, path, this->bytes_read
+                    ));
+                } catch (std::exception const & ex) {
+                    this->fail (ex.what ());
+                }
+                this->finish ();
+            });
+            return;
+        }
+
+        auto matched = this->reader_.read (this->work_pool_, path).then (
+            [this] (dsa::file_buffer contents) -> match_result {
+                this->bytes_read += contents.size ();
+                return find_matches (this->cntx_, this->work_pool_,
+                                     contents.begin (), contents.end ());
+            }
+        );
+
+        matched.on_complete (
+            [this, path] (dsa::future <match_result> f) {
+                try {
+                    this->report (path, f.get ());
+                } catch (std::exception const & ex) {
+                    this->fail (ex.what ());
+                }
+                this->finish ();
             }
+        );
+    }
+};
+
+/*
+ * Runs the search, writing results as they arrive; returns the numbers of
+ * directories and files searched, and of bytes read.
+ */
+static std::tuple <std::size_t, std::size_t, std::size_t>
+    perform_search (context const & cntx)
+{
+    dsa::task_system <> work_pool {cntx.num_threads};
+    dsa::file_reader reader;
+    output_buffer output;
+    searcher search {cntx, work_pool, reader, output};
+
+    search.start (cntx.search_path.string ());
+
+    while (true) {
+        while (auto const n = output.pop ()) {
+            (n->error ? std::cerr : std::cout) << n->text;
+            delete n;
         }
+        if (search.finished ()) {
+            /* whatever was pushed before the last finish */
+            while (auto const n = output.pop ()) {
+                (n->error ? std::cerr : std::cout) << n->text;
+                delete n;
+            }
+            break;
+        }
+        output.wait ([&search] (void) { return search.finished (); });
     }
 
+    /*
+     * Every read has finished by now, but its reader thread may still be
+     * on its way out of the completion; wait for that before the work pool
+     * is told that no more work is coming.
+     */
+    reader.wait_idle ();
     work_pool.done ();
     work_pool.wait_to_completion ();
+    std::cout << std::flush;
 
-    return std::make_tuple (
-        std::move (results), dirs_searched, files_searched, bytes_read.load ()
-    );
+    return std::make_tuple (search.dirs_searched.load (),
+                            search.files_searched.load (),
+                            search.bytes_read.load ());
 }
 
 int main (int argc, char ** argv)
@@ -294,6 +768,7 @@ int main (int argc, char ** argv)
             std::cerr << "[[info: search path " << cntx.search_path << "]]\n"
                 << "[[info: filter regex \"" << cntx.filter_string << "\"]]\n"
                 << "[[info: syntax \"" << cntx.syntax << "\"]]\n"
+                << "[[info: engine \"" << cntx.engine << "\"]]\n"
                 << "[[info: num. workers " << cntx.num_threads << "]]\n"
                 << "[[info: displaying files " << cntx.print_files << "]]\n"
                 << "[[info: displaying matches " << cntx.print_matches << "]]\n";
@@ -302,39 +777,16 @@ int main (int argc, char ** argv)
             }
         }
 
-        auto results = perform_search (cntx);
+        auto const results = perform_search (cntx);
 
         if (cntx.verbose) {
-            std::cerr << "[[info: searched " << std::get <2> (results)
-                << " files in " << std::get <1> (results)
+            std::cerr << "[[info: searched " << std::get <1> (results)
+                << " files in " << std::get <0> (results)
                 << " directories]]\n"
-                << "[[info: read " << std::get <3> (results)
+                << "[[info: read " << std::get <2> (results)
                 << " bytes in total]]"
                 << std::endl;
         }
-
-        auto & match_results = std::get <0> (results);
-        for (auto & mr : match_results) {
-            try {
-                auto const match_pair = mr.second.get ();
-                if (match_pair.first) {
-                    if (cntx.print_files && cntx.print_matches) {
-                        for (auto const & m : match_pair.second)
-                            std::cout << mr.first << ':' << m << '\n';
-                    } else if (cntx.print_files) {
-                        std::cout << mr.first;
-                    } else if (cntx.print_matches) {
-                        for (auto const & m : match_pair.second)
-                            std::cout << m << '\n';
-                    }
-                }
-            } catch (std::exception const & ex) {
-                std::cerr << "[[exception: " << ex.what () << "]]"
-                          << std::endl;
-            }
-        }
-
-        std::cout << std::flush;
     } catch (std::exception const & ex) {
         std::cerr << ex.what () << std::endl;
         return 1;
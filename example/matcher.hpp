@@ -0,0 +1,1410 @@
+//
+// matcher; the pattern matching engines of fsearch: a vectorised literal
+// prefilter in front of std::regex, and a DFA engine for a subset of the
+// ECMAScript syntax.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/awaitable-task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+
+#ifndef FSEARCH_MATCHER_HPP
+#define FSEARCH_MATCHER_HPP
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FSEARCH_X86_SIMD 1
+#endif
+
+
+namespace matcher
+{
+    /*
+     * What a pattern tells us before it is run: a literal that every match
+     * contains, if any, whether every match lies within a single line, and
+     * whether the pattern matches nothing but the literal itself.
+     */
+    struct analysis
+    {
+        std::string literal;
+        bool line_local;
+        bool exact;
+    };
+
+namespace detail
+{
+    inline bool is_quantifier (char c) noexcept
+    {
+        return c == '*' || c == '+' || c == '?' || c == '{';
+    }
+
+    /*
+     * Escapes whose set of characters includes a newline, or may.
+     */
+    inline bool may_match_newline (char c) noexcept
+    {
+        return std::strchr ("sSDWnxuc0", c) != nullptr;
+    }
+
+    /*
+     * The character an escape stands for, for the escapes that stand for
+     * one; 0 otherwise.
+     */
+    inline char escaped_char (char c) noexcept
+    {
+        switch (c) {
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        default:
+            return std::isalnum (static_cast <unsigned char> (c)) ? 0 : c;
+        }
+    }
+
+    /*
+     * Skips the bracket expression starting at pattern [i] == '['; returns
+     * the index just past it, and clears line_local if it could match a
+     * newline.
+     */
+    inline std::size_t skip_class (std::string const & pattern,
+                                   std::size_t i, bool & line_local)
+    {
+        ++i;
+        if (i < pattern.size () && pattern [i] == '^') {
+            line_local = false;
+            ++i;
+        }
+
+        for (; i < pattern.size () && pattern [i] != ']'; ++i) {
+            if (pattern [i] == '\\' && i + 1 < pattern.size ()) {
+                if (may_match_newline (pattern [++i]))
+                    line_local = false;
+            } else if (static_cast <unsigned char> (pattern [i]) < 0x20) {
+                line_local = false;
+            }
+        }
+        return i + 1;
+    }
+
+    /*
+     * Skips a quantifier at pattern [i], if there is one; returns the index
+     * just past it, and sets optional if it allows zero repetitions.
+     */
+    inline std::size_t skip_quantifier (std::string const & pattern,
+                                        std::size_t i, bool & optional)
+    {
+        optional = false;
+        if (i >= pattern.size () || !is_quantifier (pattern [i]))
+            return i;
+
+        if (pattern [i] == '{') {
+            auto const close = pattern.find ('}', i);
+            if (close == std::string::npos)
+                throw std::invalid_argument ("unterminated repetition");
+            optional = std::atoi (pattern.c_str () + i + 1) == 0;
+            i = close + 1;
+        } else {
+            optional = pattern [i] != '+';
+            ++i;
+        }
+
+        /* the lazy form */
+        if (i < pattern.size () && pattern [i] == '?')
+            ++i;
+        return i;
+    }
+}   // namespace detail
+
+    /*
+     * Finds the longest run of ordinary characters that every match of an
+     * ECMAScript pattern must contain. The analysis is conservative: an
+     * alternation at the top level, or anything it does not understand, leaves
+     * the literal empty, and a group counts as unknown characters.
+     *
+     * A match is line-local when nothing in the pattern can match a newline
+     * or depends on what lies outside the matched line (the anchors ^ and $,
+     * whose meaning changes if the regex runs over a single line).
+     */
+    inline analysis analyse (std::string const & pattern)
+    {
+        analysis a {std::string {}, true, true};
+        std::string run;
+
+        auto const flush = [&] (void) {
+            if (run.size () > a.literal.size ())
+                a.literal = run;
+            run.clear ();
+        };
+
+        try {
+            std::size_t i = 0;
+            while (i < pattern.size ()) {
+                auto const c = pattern [i];
+                bool literal = false;
+                char value = 0;
+
+                if (c == '|') {
+                    return analysis {std::string {}, false, false};
+                } else if (c == '\\') {
+                    if (i + 1 >= pattern.size ()) {
+                        a.exact = false;
+                        break;
+                    }
+                    auto const e = pattern [i + 1];
+                    if (detail::may_match_newline (e) ||
+                        (e >= '1' && e <= '9'))
+                        a.line_local = false;
+                    value = detail::escaped_char (e);
+                    literal = value != 0 && value != '\n';
+                    i += e == 'x' ? 4 : e == 'u' ? 6 : e == 'c' ? 3 : 2;
+                } else if (c == '[') {
+                    i = detail::skip_class (pattern, i, a.line_local);
+                } else if (c == '(') {
+                    /* opaque; scanned only for what it may match */
+                    int depth = 0;
+                    for (; i < pattern.size (); ++i) {
+                        auto const g = pattern [i];
+                        if (g == '\\' && i + 1 < pattern.size ()) {
+                            if (detail::may_match_newline (pattern [++i]) ||
+                                (pattern [i] >= '1' && pattern [i] <= '9'))
+                                a.line_local = false;
+                        } else if (g == '[') {
+                            i = detail::skip_class (pattern, i,
+                                                    a.line_local) - 1;
+                        } else if (g == '^' || g == '$' ||
+                                   static_cast <unsigned char> (g) < 0x20) {
+                            a.line_local = false;
+                        } else if (g == '(') {
+                            depth++;
+                        } else if (g == ')' && --depth == 0) {
+                            break;
+                        }
+                    }
+                    ++i;
+                } else if (c == '^' || c == '$') {
+                    a.line_local = false;
+                    ++i;
+                } else if (c == '.') {
+                    ++i;
+                } else if (detail::is_quantifier (c) || c == ')') {
+                    /* not where a valid pattern has one; give up */
+                    return analysis {std::string {}, false, false};
+                } else {
+                    if (static_cast <unsigned char> (c) < 0x20)
+                        a.line_local = false;
+                    value = c;
+                    literal = c != '\n';
+                    ++i;
+                }
+
+                bool optional;
+                auto const next = detail::skip_quantifier (pattern, i,
+                                                           optional);
+                bool const repeated = next != i;
+                i = next;
+
+                if (literal && !optional)
+                    run.push_back (value);
+                if (!literal || repeated) {
+                    a.exact = false;
+                    flush ();
+                }
+            }
+        } catch (std::invalid_argument const &) {
+            return analysis {std::string {}, false, false};
+        }
+
+        flush ();
+        return a;
+    }
+
+namespace detail
+{
+    using find_function = char const * (*) (char const *, char const *,
+                                            std::string const &);
+
+    inline char const * find_scalar (char const * first, char const * last,
+                                     std::string const & needle)
+    {
+        return std::search (first, last, needle.begin (), needle.end ());
+    }
+
+    /*
+     * Verifies the candidates in mask, a bit per position from p, whose
+     * first and last bytes match the needle's; the first that matches
+     * in full, or nullptr.
+     */
+    inline char const * verify (char const * p, unsigned mask,
+                                std::string const & needle) noexcept
+    {
+        auto const n = needle.size ();
+        while (mask != 0) {
+            auto const bit = __builtin_ctz (mask);
+            if (std::memcmp (p + bit + 1, needle.data () + 1, n - 2) == 0)
+                return p + bit;
+            mask &= mask - 1;
+        }
+        return nullptr;
+    }
+
+#ifdef FSEARCH_X86_SIMD
+    /*
+     * The SIMD kernels compare 16 or 32 positions at a time for a match of
+     * the needle's first and last bytes, and verify only positions where
+     * both match; needles are at least two bytes.
+     */
+    __attribute__ ((target ("sse2")))
+    inline char const * find_sse2 (char const * first, char const * last,
+                                   std::string const & needle)
+    {
+        auto const n = needle.size ();
+        auto const head = _mm_set1_epi8 (needle.front ());
+        auto const tail = _mm_set1_epi8 (needle.back ());
+
+        auto p = first;
+        for (; last - p >= static_cast <std::ptrdiff_t> (n - 1 + 16);
+             p += 16)
+        {
+            auto const a = _mm_loadu_si128 (
+                reinterpret_cast <__m128i const *> (p)
+            );
+            auto const b = _mm_loadu_si128 (
+                reinterpret_cast <__m128i const *> (p + n - 1)
+            );
+            auto const mask = static_cast <unsigned> (_mm_movemask_epi8 (
+                _mm_and_si128 (_mm_cmpeq_epi8 (a, head),
+                               _mm_cmpeq_epi8 (b, tail))
+            ));
+            if (auto const hit = verify (p, mask, needle))
+                return hit;
+        }
+        return find_scalar (p, last, needle);
+    }
+
+    __attribute__ ((target ("avx2")))
+    inline char const * find_avx2 (char const * first, char const * last,
+                                   std::string const & needle)
+    {
+        auto const n = needle.size ();
+        auto const head = _mm256_set1_epi8 (needle.front ());
+        auto const tail = _mm256_set1_epi8 (needle.back ());
+
+        auto p = first;
+        for (; last - p >= static_cast <std::ptrdiff_t> (n - 1 + 32);
+             p += 32)
+        {
+            auto const a = _mm256_loadu_si256 (
+                reinterpret_cast <__m256i const *> (p)
+            );
+            auto const b = _mm256_loadu_si256 (
+                reinterpret_cast <__m256i const *> (p + n - 1)
+            );
+            auto const mask = static_cast <unsigned> (_mm256_movemask_epi8 (
+                _mm256_and_si256 (_mm256_cmpeq_epi8 (a, head),
+                                  _mm256_cmpeq_epi8 (b, tail))
+            ));
+            if (auto const hit = verify (p, mask, needle))
+                return hit;
+        }
+        return find_sse2 (p, last, needle);
+    }
+#endif
+
+    inline find_function best_find (void)
+    {
+#ifdef FSEARCH_X86_SIMD
+        __builtin_cpu_init ();
+        if (__builtin_cpu_supports ("avx2"))
+            return &find_avx2;
+        if (__builtin_cpu_supports ("sse2"))
+            return &find_sse2;
+#endif
+        return &find_scalar;
+    }
+}   // namespace detail
+
+    /*
+     * finder; searches for a literal string, with the widest SIMD kernel
+     * that the processor supports.
+     */
+    class finder
+    {
+        std::string needle_;
+
+    public:
+        explicit finder (std::string needle)
+            : needle_ {std::move (needle)}
+        {}
+
+        bool empty (void) const noexcept
+        {
+            return this->needle_.empty ();
+        }
+
+        /*
+         * The first occurrence of the literal in [first, last), or last.
+         */
+        char const * find (char const * first, char const * last) const
+        {
+            static detail::find_function const kernel = detail::best_find ();
+
+            auto const n = this->needle_.size ();
+            if (n == 0 || static_cast <std::size_t> (last - first) < n)
+                return n == 0 ? first : last;
+            if (n == 1) {
+                auto const p = std::memchr (
+                    first, this->needle_ [0],
+                    static_cast <std::size_t> (last - first)
+                );
+                return p ? static_cast <char const *> (p) : last;
+            }
+
+            auto const hit = kernel (first, last, this->needle_);
+            return hit ? hit : last;
+        }
+    };
+
+namespace detail
+{
+    /*
+     * The DFA engine's parse tree.
+     */
+    struct node
+    {
+        enum kind_type { set, concat, alternate, repeat };
+
+        kind_type kind;
+        std::bitset <256> bytes;
+        std::vector <node> children;
+        int min;
+        int max;
+    };
+
+    class parser
+    {
+        std::string const & p_;
+        std::size_t i_ {0};
+
+        [[noreturn]] void fail (char const * what) const
+        {
+            throw std::invalid_argument (
+                std::string {"dfa engine: "} + what + " in \"" + this->p_ +
+                "\""
+            );
+        }
+
+        bool more (void) const noexcept
+        {
+            return this->i_ < this->p_.size ();
+        }
+
+        char peek (void) const noexcept
+        {
+            return this->p_ [this->i_];
+        }
+
+        static std::bitset <256> one (unsigned char c)
+        {
+            std::bitset <256> b;
+            b.set (c);
+            return b;
+        }
+
+        static int only (std::bitset <256> const & b) noexcept
+        {
+            int c = 0;
+            while (!b.test (static_cast <std::size_t> (c)))
+                ++c;
+            return c;
+        }
+
+        static std::bitset <256> range (int lo, int hi)
+        {
+            std::bitset <256> b;
+            for (int c = lo; c <= hi; ++c)
+                b.set (static_cast <std::size_t> (c));
+            return b;
+        }
+
+        static std::bitset <256> escape_set (char e)
+        {
+            switch (e) {
+            case 'd':
+                return range ('0', '9');
+            case 'w':
+                return range ('0', '9') | range ('a', 'z') |
+                    range ('A', 'Z') | one ('_');
+            case 's':
+                return one (' ') | one ('\t') | one ('\n') | one ('\r') |
+                    one ('\f') | one ('\v');
+            case 'D':
+                return ~escape_set ('d');
+            case 'W':
+                return ~escape_set ('w');
+            case 'S':
+                return ~escape_set ('s');
+            default:
+                return std::bitset <256> {};
+            }
+        }
+
+        /*
+         * The escape after a backslash; a set of one or more bytes.
+         */
+        std::bitset <256> escape (void)
+        {
+            if (!this->more ())
+                this->fail ("trailing backslash");
+            auto const e = this->p_ [this->i_++];
+
+            auto const s = escape_set (e);
+            if (s.any ())
+                return s;
+            if (e == '0')
+                return one (0);
+            if (e == 'x') {
+                if (this->i_ + 2 > this->p_.size ())
+                    this->fail ("short \\x escape");
+                auto const hex = this->p_.substr (this->i_, 2);
+                this->i_ += 2;
+                return one (static_cast <unsigned char> (
+                    std::stoi (hex, nullptr, 16)
+                ));
+            }
+
+            auto const c = escaped_char (e);
+            if (c == 0)
+                this->fail ("unsupported escape");
+            return one (static_cast <unsigned char> (c));
+        }
+
+        std::bitset <256> bracket (void)
+        {
+            std::bitset <256> b;
+            bool const negate = this->more () && this->peek () == '^';
+            if (negate)
+                this->i_++;
+
+            while (this->more () && this->peek () != ']') {
+                std::bitset <256> item;
+                int lo = -1;
+                if (this->peek () == '\\') {
+                    this->i_++;
+                    item = this->escape ();
+                    if (item.count () == 1)
+                        lo = only (item);
+                } else {
+                    lo = static_cast <unsigned char> (this->p_ [this->i_++]);
+                    item = one (static_cast <unsigned char> (lo));
+                }
+
+                if (lo >= 0 && this->i_ + 1 < this->p_.size () &&
+                    this->peek () == '-' && this->p_ [this->i_ + 1] != ']')
+                {
+                    this->i_++;
+                    int hi;
+                    if (this->peek () == '\\') {
+                        this->i_++;
+                        auto const h = this->escape ();
+                        if (h.count () != 1)
+                            this->fail ("bad range");
+                        hi = only (h);
+                    } else {
+                        hi = static_cast <unsigned char> (
+                            this->p_ [this->i_++]
+                        );
+                    }
+                    if (hi < lo)
+                        this->fail ("bad range");
+                    item = range (lo, hi);
+                }
+                b |= item;
+            }
+
+            if (!this->more ())
+                this->fail ("unterminated bracket expression");
+            this->i_++;
+            return negate ? ~b : b;
+        }
+
+        node atom (void)
+        {
+            auto const c = this->p_ [this->i_++];
+            node n {node::set, {}, {}, 1, 1};
+            switch (c) {
+            case '.':
+                n.bytes = ~(one ('\n') | one ('\r'));
+                break;
+            case '[':
+                n.bytes = this->bracket ();
+                break;
+            case '\\':
+                if (this->more () && std::strchr ("bB123456789", this->peek ()))
+                    this->fail ("assertions and back references are"
+                                " unsupported");
+                n.bytes = this->escape ();
+                break;
+            case '(':
+                if (this->more () && this->peek () == '?') {
+                    if (this->i_ + 1 < this->p_.size () &&
+                        this->p_ [this->i_ + 1] == ':')
+                        this->i_ += 2;
+                    else
+                        this->fail ("lookaround is unsupported");
+                }
+                n = this->alternation ();
+                if (!this->more () || this->peek () != ')')
+                    this->fail ("unbalanced parenthesis");
+                this->i_++;
+                break;
+            case '^':
+            case '$':
+                this->fail ("anchors are unsupported");
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+            case ')':
+                this->fail ("misplaced operator");
+            default:
+                n.bytes = one (static_cast <unsigned char> (c));
+            }
+            return n;
+        }
+
+        node quantified (void)
+        {
+            auto n = this->atom ();
+            while (this->more () && is_quantifier (this->peek ())) {
+                int min = 0, max = -1;
+                auto const q = this->p_ [this->i_++];
+                if (q == '+') {
+                    min = 1;
+                } else if (q == '?') {
+                    max = 1;
+                } else if (q == '{') {
+                    auto const close = this->p_.find ('}', this->i_);
+                    if (close == std::string::npos)
+                        this->fail ("unterminated repetition");
+                    auto const body = this->p_.substr (
+                        this->i_, close - this->i_
+                    );
+                    this->i_ = close + 1;
+                    auto const comma = body.find (',');
+                    min = std::stoi (body);
+                    max = comma == std::string::npos ? min :
+                        comma + 1 == body.size () ? -1 :
+                        std::stoi (body.substr (comma + 1));
+                    if ((max >= 0 && max < min) || min > 1000 || max > 1000)
+                        this->fail ("bad repetition");
+                }
+
+                /* leftmost-longest; laziness makes no difference */
+                if (this->more () && this->peek () == '?')
+                    this->i_++;
+
+                node r {node::repeat, {}, {}, min, max};
+                r.children.push_back (std::move (n));
+                n = std::move (r);
+            }
+            return n;
+        }
+
+        node sequence (void)
+        {
+            node n {node::concat, {}, {}, 1, 1};
+            while (this->more () && this->peek () != '|' &&
+                   this->peek () != ')')
+                n.children.push_back (this->quantified ());
+            return n;
+        }
+
+        node alternation (void)
+        {
+            node n {node::alternate, {}, {}, 1, 1};
+            n.children.push_back (this->sequence ());
+            while (this->more () && this->peek () == '|') {
+                this->i_++;
+                n.children.push_back (this->sequence ());
+            }
+            return n;
+        }
+
+    public:
+        explicit parser (std::string const & pattern)
+            : p_ (pattern)
+        {}
+
+        node parse (void)
+        {
+            auto n = this->alternation ();
+            if (this->more ())
+                this->fail ("unbalanced parenthesis");
+            return n;
+        }
+    };
+
+    /*
+     * A Thompson NFA over bytes: each state has epsilon edges, and at most
+     * one edge on a set of bytes.
+     */
+    struct nfa
+    {
+        static constexpr std::size_t none = static_cast <std::size_t> (-1);
+
+        struct state
+        {
+            std::bitset <256> bytes;
+            std::size_t next;
+            std::vector <std::size_t> epsilon;
+        };
+
+        std::vector <state> states;
+
+        std::size_t add (void)
+        {
+            this->states.push_back (state {std::bitset <256> {}, none, {}});
+            return this->states.size () - 1;
+        }
+
+        void link (std::size_t from, std::size_t to)
+        {
+            this->states [from].epsilon.push_back (to);
+        }
+
+        /*
+         * Compiles n between a fresh start and end state, returned as a
+         * pair; the end state has no outgoing edges yet.
+         */
+        std::pair <std::size_t, std::size_t> compile (node const & n)
+        {
+            auto const s = this->add ();
+            auto const e = this->add ();
+            switch (n.kind) {
+            case node::set:
+                this->states [s].bytes = n.bytes;
+                this->states [s].next = e;
+                break;
+            case node::concat: {
+                auto at = s;
+                for (auto const & c : n.children) {
+                    auto const f = this->compile (c);
+                    this->link (at, f.first);
+                    at = f.second;
+                }
+                this->link (at, e);
+                break;
+            }
+            case node::alternate:
+                for (auto const & c : n.children) {
+                    auto const f = this->compile (c);
+                    this->link (s, f.first);
+                    this->link (f.second, e);
+                }
+                break;
+            case node::repeat: {
+                auto at = s;
+                for (int k = 0; k < n.min; ++k) {
+                    auto const f = this->compile (n.children.front ());
+                    this->link (at, f.first);
+                    at = f.second;
+                }
+                if (n.max < 0) {
+                    auto const f = this->compile (n.children.front ());
+                    this->link (at, f.first);
+                    this->link (f.second, f.first);
+                    this->link (f.second, e);
+                } else {
+                    for (int k = n.min; k < n.max; ++k) {
+                        auto const f = this->compile (n.children.front ());
+                        this->link (at, f.first);
+                        this->link (at, e);
+                        at = f.second;
+                    }
+                }
+                this->link (at, e);
+                break;
+            }
+            default:
+                break;
+            }
+            return std::make_pair (s, e);
+        }
+
+        /*
+         * Replaces set with its closure under epsilon edges, sorted.
+         */
+        void close (std::vector <std::size_t> & set) const
+        {
+            std::vector <bool> seen (this->states.size ());
+            std::vector <std::size_t> stack (set.begin (), set.end ());
+            set.clear ();
+            while (!stack.empty ()) {
+                auto const s = stack.back ();
+                stack.pop_back ();
+                if (seen [s])
+                    continue;
+                seen [s] = true;
+                set.push_back (s);
+                for (auto t : this->states [s].epsilon)
+                    stack.push_back (t);
+            }
+            std::sort (set.begin (), set.end ());
+        }
+    };
+}   // namespace detail
+
+    /*
+     * dfa; a deterministic automaton built up front from patterns in a
+     * subset of the ECMAScript syntax: characters and escapes, ., bracket
+     * expressions, \d \w \s and their complements, groups, alternation, and
+     * the quantifiers * + ? and {n,m}. Assertions, back references, and
+     * lookaround are rejected. It reports the leftmost-longest match at
+     * each position, as POSIX does, rather than the leftmost-first match of
+     * ECMAScript, and never backtracks.
+     *
+     * The automaton is run afresh from every position where a match could
+     * start, for as long as some match is still possible, so that the time
+     * taken is linear in the input only while those runs are bounded. They
+     * are for most patterns, since . never crosses a line end, but not for
+     * all: .*x over a long line with no x in it takes time quadratic in the
+     * length of the line.
+     *
+     * Built from several patterns, it finds the matches of all of them in
+     * the same pass, each pattern's own matches without overlap.
+     *
+     * The automaton is immutable once built, so one dfa can be shared by
+     * any number of threads.
+     */
+    class dfa
+    {
+        static constexpr std::size_t max_states = 100000;
+
+        std::size_t patterns_ {0};
+        std::vector <std::size_t> class_of_;
+        std::size_t classes_ {0};
+        std::vector <int> table_;
+        std::vector <std::vector <std::size_t>> accepts_;
+        std::bitset <256> first_;
+        bool empty_ {false};
+
+    public:
+        /*
+         * Throws std::invalid_argument for patterns outside the subset, and
+         * std::length_error when the automaton would be too large.
+         */
+        explicit dfa (std::vector <std::string> const & patterns)
+            : patterns_ {patterns.size ()}
+            , class_of_ (256)
+        {
+            using state_set = std::vector <std::size_t>;
+
+            detail::nfa n;
+            auto const start = n.add ();
+            std::map <std::size_t, std::size_t> ends;
+            for (std::size_t k = 0; k < patterns.size (); ++k) {
+                auto const f = n.compile (
+                    detail::parser {patterns [k]}.parse ()
+                );
+                n.link (start, f.first);
+                ends.emplace (f.second, k);
+            }
+
+            /*
+             * Bytes that no edge tells apart behave alike in every state,
+             * so the table has a column per class of them.
+             */
+            std::map <std::vector <bool>, std::size_t> signatures;
+            std::vector <std::size_t> representative;
+            for (std::size_t c = 0; c < 256; ++c) {
+                std::vector <bool> key;
+                for (auto const & st : n.states)
+                    if (st.next != detail::nfa::none)
+                        key.push_back (st.bytes.test (c));
+                auto const r = signatures.emplace (key, representative.size ());
+                if (r.second)
+                    representative.push_back (c);
+                this->class_of_ [c] = r.first->second;
+            }
+            this->classes_ = representative.size ();
+
+            std::map <state_set, int> ids;
+            std::vector <state_set> sets;
+
+            auto const intern = [&] (state_set set) -> int {
+                n.close (set);
+                auto const it = ids.find (set);
+                if (it != ids.end ())
+                    return it->second;
+
+                if (sets.size () >= max_states)
+                    throw std::length_error (
+                        "dfa engine: patterns need too many states"
+                    );
+                auto const id = static_cast <int> (sets.size ());
+                std::vector <std::size_t> accepts;
+                for (auto s : set) {
+                    auto const e = ends.find (s);
+                    if (e != ends.end ())
+                        accepts.push_back (e->second);
+                }
+                this->accepts_.push_back (std::move (accepts));
+                ids.emplace (set, id);
+                sets.push_back (std::move (set));
+                return id;
+            };
+
+            intern (state_set {start});
+            for (std::size_t d = 0; d < sets.size (); ++d) {
+                this->table_.resize ((d + 1) * this->classes_, -1);
+                for (std::size_t k = 0; k < this->classes_; ++k) {
+                    state_set next;
+                    for (auto s : sets [d]) {
+                        auto const & st = n.states [s];
+                        if (st.next != detail::nfa::none &&
+                            st.bytes.test (representative [k]))
+                            next.push_back (st.next);
+                    }
+                    if (!next.empty ())
+                        this->table_ [d * this->classes_ + k] =
+                            intern (std::move (next));
+                }
+            }
+
+            for (std::size_t c = 0; c < 256; ++c)
+                this->first_.set (c, this->table_ [this->class_of_ [c]] >= 0);
+            this->empty_ = !this->accepts_ [0].empty ();
+        }
+
+        explicit dfa (std::string const & pattern)
+            : dfa (std::vector <std::string> {pattern})
+        {}
+
+        /*
+         * Calls out (k, begin, end) for each match of the k-th pattern in
+         * [first, last): for each pattern, left to right and without
+         * overlap, the longest at each position.
+         */
+        template <class Out>
+        void find_each (char const * first, char const * last, Out && out)
+            const
+        {
+            std::vector <char const *> next (this->patterns_, first);
+            std::vector <char const *> longest (this->patterns_, nullptr);
+            std::vector <std::size_t> found;
+
+            for (auto p = first; p <= last; ++p) {
+                if (p < last && !this->empty_ &&
+                    !this->first_.test (static_cast <unsigned char> (*p)))
+                    continue;
+
+                auto const accept = [&] (std::size_t s, char const * end) {
+                    for (auto k : this->accepts_ [s]) {
+                        if (!longest [k])
+                            found.push_back (k);
+                        longest [k] = end;
+                    }
+                };
+
+                accept (0, p);
+                std::size_t s = 0;
+                for (auto q = p; q < last; ++q) {
+                    auto const t = this->table_ [
+                        s * this->classes_ +
+                        this->class_of_ [static_cast <unsigned char> (*q)]
+                    ];
+                    if (t < 0)
+                        break;
+                    s = static_cast <std::size_t> (t);
+                    accept (s, q + 1);
+                }
+
+                for (auto k : found) {
+                    if (p >= next [k]) {
+                        out (k, p, longest [k]);
+                        next [k] = longest [k] > p ? longest [k] : p + 1;
+                    }
+                    longest [k] = nullptr;
+                }
+                found.clear ();
+            }
+        }
+
+        /*
+         * As find_each, calling out (begin, end), for a dfa of one pattern.
+         */
+        template <class Out>
+        void find_all (char const * first, char const * last, Out && out)
+            const
+        {
+            this->find_each (first, last,
+                [&out] (std::size_t, char const * b, char const * e) {
+                    out (b, e);
+                }
+            );
+        }
+    };
+
+    /*
+     * aho_corasick; finds every occurrence of any of a set of literal
+     * strings in one pass, whatever their number, in a table-driven
+     * automaton with a column per class of bytes that the strings use.
+     */
+    class aho_corasick
+    {
+        std::vector <std::size_t> lengths_;
+        std::array <std::uint32_t, 256> class_of_;
+        std::size_t classes_ {1};
+        std::vector <std::uint32_t> table_;
+        std::vector <std::vector <std::size_t>> own_;
+        std::vector <std::uint32_t> dict_;
+        std::vector <bool> output_;
+
+    public:
+        aho_corasick (void) noexcept = default;
+
+        /*
+         * The words must not be empty.
+         */
+        explicit aho_corasick (std::vector <std::string> const & words)
+        {
+            this->class_of_.fill (0);
+            for (auto const & w : words) {
+                this->lengths_.push_back (w.size ());
+                for (auto c : w) {
+                    auto & k = this->class_of_ [byte (c)];
+                    if (k == 0)
+                        k = static_cast <std::uint32_t> (this->classes_++);
+                }
+            }
+
+            /* the trie; 0 is the root, and never a child */
+            auto const grow = [this] (void) -> std::uint32_t {
+                this->table_.resize (this->table_.size () + this->classes_, 0);
+                this->own_.emplace_back ();
+                return static_cast <std::uint32_t> (this->own_.size () - 1);
+            };
+            grow ();
+            for (std::size_t i = 0; i < words.size (); ++i) {
+                std::uint32_t s = 0;
+                for (auto c : words [i]) {
+                    auto const at = s * this->classes_ +
+                        this->class_of_ [byte (c)];
+                    if (this->table_ [at] == 0) {
+                        auto const t = grow ();
+                        this->table_ [at] = t;
+                    }
+                    s = this->table_ [at];
+                }
+                this->own_ [s].push_back (i);
+            }
+
+            /*
+             * Breadth first, each state's missing edges are those of its
+             * failure state, which is shallower and so already complete.
+             */
+            auto const states = this->own_.size ();
+            std::vector <std::uint32_t> fail (states, 0);
+            this->dict_.assign (states, 0);
+            std::vector <std::uint32_t> queue;
+            for (std::size_t k = 0; k < this->classes_; ++k)
+                if (auto const t = this->table_ [k])
+                    queue.push_back (t);
+
+            for (std::size_t q = 0; q < queue.size (); ++q) {
+                auto const u = queue [q];
+                for (std::size_t k = 0; k < this->classes_; ++k) {
+                    auto & v = this->table_ [u * this->classes_ + k];
+                    auto const via =
+                        this->table_ [fail [u] * this->classes_ + k];
+                    if (v == 0) {
+                        v = via;
+                        continue;
+                    }
+                    fail [v] = via;
+                    this->dict_ [v] = this->own_ [via].empty () ?
+                        this->dict_ [via] : via;
+                    queue.push_back (v);
+                }
+            }
+
+            this->output_.resize (states);
+            for (std::size_t s = 0; s < states; ++s)
+                this->output_ [s] = !this->own_ [s].empty () ||
+                    this->dict_ [s] != 0;
+        }
+
+        bool empty (void) const noexcept
+        {
+            return this->lengths_.empty ();
+        }
+
+        /*
+         * Calls out (i, begin, end) for every occurrence of the i-th word in
+         * [first, last), overlapping ones included, in order of their end.
+         */
+        template <class Out>
+        void find_each (char const * first, char const * last, Out && out)
+            const
+        {
+            std::uint32_t s = 0;
+            for (auto p = first; p < last; ++p) {
+                s = this->next (s, *p);
+                if (!this->output_ [s])
+                    continue;
+                for (auto t = this->own_ [s].empty () ? this->dict_ [s] : s;
+                     t != 0; t = this->dict_ [t])
+                    for (auto i : this->own_ [t])
+                        out (i, p + 1 - this->lengths_ [i], p + 1);
+            }
+        }
+
+        /*
+         * The end of the first occurrence of any word in [first, last), or
+         * nullptr.
+         */
+        char const * find_any (char const * first, char const * last) const
+        {
+            std::uint32_t s = 0;
+            for (auto p = first; p < last; ++p) {
+                s = this->next (s, *p);
+                if (this->output_ [s])
+                    return p + 1;
+            }
+            return nullptr;
+        }
+
+    private:
+        static std::size_t byte (char c) noexcept
+        {
+            return static_cast <unsigned char> (c);
+        }
+
+        std::uint32_t next (std::uint32_t s, char c) const noexcept
+        {
+            return this->table_ [
+                s * this->classes_ + this->class_of_ [byte (c)]
+            ];
+        }
+    };
+
+    enum class engine { std_regex, dfa };
+
+    /*
+     * pattern; one search pattern, compiled for the chosen engine, with a
+     * literal prefilter when the pattern has a required literal. Only
+     * lines containing the literal are handed to the engine, when every
+     * match lies within a line; otherwise the literal only rules out
+     * buffers that do not contain it at all.
+     */
+    class pattern
+    {
+        std::string source_;
+        std::regex regex_;
+        std::shared_ptr <matcher::dfa const> dfa_;
+        finder literal_;
+        bool line_local_;
+
+        template <class Out>
+        void run (char const * first, char const * last,
+                  char const * start, Out & out) const
+        {
+            if (this->dfa_) {
+                this->dfa_->find_all (first, last, out);
+                return;
+            }
+
+            auto const flags = first == start ?
+                std::regex_constants::match_default :
+                std::regex_constants::match_prev_avail;
+            auto const end = std::cregex_iterator {};
+            for (auto it = std::cregex_iterator {first, last, this->regex_,
+                                                 flags};
+                 it != end; ++it)
+            {
+                out ((*it) [0].first, (*it) [0].second);
+            }
+        }
+
+    public:
+        /*
+         * The prefilter is only used for the ECMAScript syntax, which is the
+         * only one analyse understands; the dfa engine requires it.
+         */
+        pattern (std::string source,
+                 std::regex_constants::syntax_option_type syntax,
+                 engine e)
+            : source_ {std::move (source)}
+            , literal_ {std::string {}}
+            , line_local_ {false}
+        {
+            using namespace std::regex_constants;
+            bool const ecmascript =
+                (syntax & (basic | extended | awk | grep | egrep)) == 0 &&
+                (syntax & icase) == 0;
+
+            if (e == engine::dfa) {
+                if (!ecmascript)
+                    throw std::invalid_argument (
+                        "the dfa engine requires the ECMAScript syntax"
+                    );
+                this->dfa_ = std::make_shared <matcher::dfa> (this->source_);
+            } else {
+                this->regex_ = std::regex {this->source_, syntax};
+            }
+
+            if (ecmascript) {
+                auto a = analyse (this->source_);
+                this->literal_ = finder {std::move (a.literal)};
+                this->line_local_ = a.line_local;
+            }
+        }
+
+        std::string const & source (void) const noexcept
+        {
+            return this->source_;
+        }
+
+        /*
+         * Calls out (begin, end) for each match in [first, last), in order.
+         */
+        template <class Out>
+        void find_all (char const * first, char const * last, Out out) const
+        {
+            if (this->literal_.empty ()) {
+                this->run (first, last, first, out);
+                return;
+            }
+
+            auto hit = this->literal_.find (first, last);
+            if (hit == last)
+                return;
+            if (!this->line_local_) {
+                this->run (first, last, first, out);
+                return;
+            }
+
+            while (hit != last) {
+                auto line = hit;
+                while (line != first && line [-1] != '\n')
+                    --line;
+                auto const eol = static_cast <char const *> (
+                    std::memchr (hit, '\n',
+                                 static_cast <std::size_t> (last - hit))
+                );
+                auto const line_end = eol ? eol : last;
+
+                this->run (line, line_end, first, out);
+                if (line_end == last)
+                    return;
+                hit = this->literal_.find (line_end + 1, last);
+            }
+        }
+    };
+    /*
+     * pattern_set; every pattern of a search, matched as far as possible in
+     * one pass over the data rather than one pass per pattern. Patterns
+     * that are plain literals go into one Aho-Corasick automaton. With the
+     * dfa engine the others go into one combined dfa, which only runs over
+     * lines holding one of their required literals when they all have one
+     * and match within lines. Under std::regex, whose leftmost-first
+     * matches cannot be combined this way, each remaining pattern makes a
+     * pass of its own, literal prefilter included; so do dfa patterns when
+     * their combined automaton would be too large.
+     *
+     * Each pattern's matches are reported in order and without overlap, as
+     * by a search for that pattern alone.
+     */
+    class pattern_set
+    {
+        std::size_t size_ {0};
+        bool line_local_ {false};
+
+        aho_corasick words_;
+        std::vector <std::size_t> word_index_;
+
+        std::shared_ptr <matcher::dfa const> combined_;
+        std::vector <std::size_t> combined_index_;
+        aho_corasick combined_literals_;
+
+        std::vector <std::pair <std::size_t, pattern>> singles_;
+
+        template <class Out>
+        void run_combined (char const * first, char const * last,
+                           Out & out) const
+        {
+            auto const report = [&] (std::size_t k, char const * b,
+                                     char const * e) {
+                out (this->combined_index_ [k], b, e);
+            };
+
+            if (this->combined_literals_.empty ()) {
+                this->combined_->find_each (first, last, report);
+                return;
+            }
+
+            auto at = first;
+            while (auto const hit = this->combined_literals_.find_any (
+                       at, last))
+            {
+                auto line = hit - 1;
+                while (line != first && line [-1] != '\n')
+                    --line;
+                auto const eol = static_cast <char const *> (
+                    std::memchr (hit - 1, '\n',
+                                 static_cast <std::size_t> (last - hit + 1))
+                );
+                auto const line_end = eol ? eol : last;
+
+                this->combined_->find_each (line, line_end, report);
+                if (line_end == last)
+                    return;
+                at = line_end + 1;
+            }
+        }
+
+    public:
+        pattern_set (void) = default;
+
+        /*
+         * Throws as std::regex or dfa do for a pattern that they reject.
+         */
+        pattern_set (std::vector <std::string> const & sources,
+                     std::regex_constants::syntax_option_type syntax,
+                     engine e)
+            : size_ {sources.size ()}
+        {
+            using namespace std::regex_constants;
+            bool const ecmascript =
+                (syntax & (basic | extended | awk | grep | egrep)) == 0 &&
+                (syntax & icase) == 0;
+
+            std::vector <std::string> words;
+            std::vector <std::size_t> rest;
+            this->line_local_ = !sources.empty ();
+            for (std::size_t i = 0; i < sources.size (); ++i) {
+                auto const a = ecmascript ? analyse (sources [i]) :
+                    analysis {std::string {}, false, false};
+                this->line_local_ = this->line_local_ && a.line_local;
+                if (a.exact && !a.literal.empty ()) {
+                    words.push_back (a.literal);
+                    this->word_index_.push_back (i);
+                } else {
+                    rest.push_back (i);
+                }
+            }
+            if (!words.empty ())
+                this->words_ = aho_corasick {words};
+
+            if (e == engine::dfa && rest.size () > 1 && ecmascript) {
+                std::vector <std::string> patterns;
+                std::vector <std::string> literals;
+                bool prefilter = true;
+                for (auto i : rest) {
+                    patterns.push_back (sources [i]);
+                    auto const a = analyse (sources [i]);
+                    prefilter = prefilter && a.line_local &&
+                        !a.literal.empty ();
+                    literals.push_back (a.literal);
+                }
+
+                try {
+                    this->combined_ = std::make_shared <matcher::dfa> (
+                        patterns
+                    );
+                    this->combined_index_ = rest;
+                    if (prefilter)
+                        this->combined_literals_ = aho_corasick {literals};
+                    return;
+                } catch (std::length_error const &) {
+                    /* too large combined; each on its own instead */
+                }
+            }
+
+            for (auto i : rest)
+                this->singles_.emplace_back (
+                    i, pattern {sources [i], syntax, e}
+                );
+        }
+
+        std::size_t size (void) const noexcept
+        {
+            return this->size_;
+        }
+
+        /*
+         * Whether every match of every pattern is known to lie within a
+         * single line; if so, the matches in a buffer are those in each of
+         * its lines, and a buffer may be searched in pieces split after
+         * newlines.
+         */
+        bool line_local (void) const noexcept
+        {
+            return this->line_local_;
+        }
+
+        /*
+         * Calls out (i, begin, end) for each match of the i-th pattern in
+         * [first, last).
+         */
+        template <class Out>
+        void find_all (char const * first, char const * last, Out out) const
+        {
+            if (!this->words_.empty ()) {
+                std::vector <char const *> next (this->word_index_.size (),
+                                                 first);
+                this->words_.find_each (first, last,
+                    [&] (std::size_t w, char const * b, char const * e) {
+                        if (b >= next [w]) {
+                            next [w] = e;
+                            out (this->word_index_ [w], b, e);
+                        }
+                    }
+                );
+            }
+
+            if (this->combined_)
+                this->run_combined (first, last, out);
+
+            for (auto const & s : this->singles_) {
+                auto const i = s.first;
+                s.second.find_all (first, last,
+                    [&out, i] (char const * b, char const * e) {
+                        out (i, b, e);
+                    }
+                );
+            }
+        }
+    };
+}   // namespace matcher
+
+#endif  // #ifndef FSEARCH_MATCHER_HPP
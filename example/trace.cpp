@@ -0,0 +1,79 @@
+//
+// trace; runs labeled tasks, plain and pushed with a cancellation, and checks
+// that each one appears under its label in the Chrome trace.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+// build: c++ -std=c++11 -O2 -pthread -DDSA_TASK_TRACE trace.cpp -o trace
+// usage: trace [output.json]
+//
+// The trace is written to the named file, if one is given, for viewing in
+// chrome://tracing or Perfetto. The exit status is nonzero if a label is
+// missing from it.
+//
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../task.hpp"
+
+#ifndef DSA_TASK_TRACE
+#error "trace.cpp must be built with -DDSA_TASK_TRACE"
+#endif
+
+int main (int argc, char ** argv)
+{
+    std::ostringstream trace;
+    {
+        dsa::task_system <> ts {2};
+        dsa::cancellation_source src;
+
+        ts.post (dsa::label ("plain_post", [] (void) {}));
+        ts.post (dsa::cancellation {src.token ()},
+                 dsa::label ("cancellable_post", [] (void) {}));
+        auto plain = ts.push (dsa::label ("plain_push", [] (void) {
+            return 1;
+        }));
+        auto cancellable = ts.push (dsa::cancellation {src.token ()},
+                                    dsa::label ("cancellable_push",
+                                                [] (void) { return 2; }));
+        plain.get ();
+        cancellable.get ();
+
+        ts.wait_idle ();
+        ts.write_trace (trace);
+    }
+
+    if (argc > 1) {
+        std::ofstream out {argv [1]};
+        out << trace.str ();
+    }
+
+    auto const text = trace.str ();
+    int missing = 0;
+    for (auto const name : {"plain_post", "cancellable_post",
+                            "plain_push", "cancellable_push"})
+    {
+        if (text.find (std::string {"\""} + name + "\"") == std::string::npos)
+        {
+            std::cerr << "missing from the trace: " << name << '\n';
+            missing++;
+        }
+    }
+    return missing == 0 ? 0 : 1;
+}
@@ -0,0 +1,734 @@
+//
+// dsa is a utility library of data structures and algorithms built with C++11.
+// This file (future.hpp) is part of the dsa project.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+
+#ifndef DSA_FUTURE_HPP
+#define DSA_FUTURE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "task.hpp"
+#include "utilities/functions.hpp"
+#include "utilities/sequence.hpp"
+
+
+namespace dsa
+{
+    template <class T>
+    class future;
+
+    /*
+     * when_any_result; the value of the future returned by when_any: the
+     * index of the first input to become ready, and all of the inputs.
+     */
+    template <class Sequence>
+    struct when_any_result
+    {
+        std::size_t index;
+        Sequence futures;
+    };
+
+namespace detail
+{
+    /*
+     * executor; the task_system that a chain of futures schedules its
+     * continuations on, with its type erased.
+     */
+    struct executor
+    {
+        void * system;
+        void (*push) (void *, task &&);
+
+        template <class System>
+        static void push_on (void * s, task && t)
+        {
+            static_cast <System *> (s)->push (std::move (t));
+        }
+
+        template <class System>
+        static executor of (System & s) noexcept
+        {
+            return executor {&s, &push_on <System>};
+        }
+    };
+
+    struct future_state_base;
+
+    /*
+     * resume_call; a continuation on its way to the executor, and the state
+     * it continues from. Until that state is ready the continuation belongs
+     * to it and refers back to it by plain pointer only, so that a state
+     * which is never completed frees its continuation along with itself
+     * instead of being kept alive by it; from then on, this keeps the state
+     * alive until the continuation has run.
+     */
+    struct resume_call
+    {
+        std::shared_ptr <future_state_base> src;
+        task k;
+
+        void operator() (void)
+        {
+            this->k ();
+        }
+    };
+
+    /*
+     * future_state_base; what a future shares with whatever fulfils it: the
+     * executor, the ready flag and any exception, and at most one
+     * continuation. The continuation is a task, pushed onto the executor
+     * once the state is ready rather than run by the thread that completed
+     * it.
+     */
+    struct future_state_base : std::enable_shared_from_this <future_state_base>
+    {
+        executor exec;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool ready {false};
+        std::exception_ptr error;
+        task continuation;
+
+        explicit future_state_base (executor e)
+            : exec (e)
+        {}
+
+        /*
+         * Publishes the value or exception set beforehand; only ever called
+         * once, by the producer.
+         */
+        void complete (void)
+        {
+            task k;
+            {
+                std::unique_lock <std::mutex> lock (this->mutex);
+                this->ready = true;
+                k = std::move (this->continuation);
+            }
+
+            this->cv.notify_all ();
+            if (k)
+                this->resume (std::move (k));
+        }
+
+        void on_ready (task && k)
+        {
+            {
+                std::unique_lock <std::mutex> lock (this->mutex);
+                if (!this->ready) {
+                    this->continuation = std::move (k);
+                    return;
+                }
+            }
+
+            this->resume (std::move (k));
+        }
+
+        bool is_ready (void)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex);
+            return this->ready;
+        }
+
+        void wait (void)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex);
+            while (!this->ready)
+                this->cv.wait (lock);
+        }
+
+    private:
+        void resume (task && k)
+        {
+            this->exec.push (this->exec.system, task_access::make_detached (
+                resume_call {this->shared_from_this (), std::move (k)}
+            ));
+        }
+    };
+
+    template <class T>
+    struct future_state : future_state_base
+    {
+        union { T value; };
+        bool has_value {false};
+
+        explicit future_state (executor e)
+            : future_state_base (e)
+        {}
+
+        ~future_state (void)
+        {
+            if (this->has_value)
+                this->value.~T ();
+        }
+
+        template <class ... U>
+        void emplace (U && ... u)
+        {
+            ::new (static_cast <void *> (std::addressof (this->value)))
+                T (std::forward <U> (u)...);
+            this->has_value = true;
+        }
+
+        /*
+         * Ready states only.
+         */
+        T take (void)
+        {
+            if (this->error)
+                std::rethrow_exception (this->error);
+            return std::move (this->value);
+        }
+    };
+
+    template <>
+    struct future_state <void> : future_state_base
+    {
+        explicit future_state (executor e)
+            : future_state_base (e)
+        {}
+
+        void emplace (void) noexcept
+        {}
+
+        void take (void)
+        {
+            if (this->error)
+                std::rethrow_exception (this->error);
+        }
+    };
+
+    /*
+     * Sets s to the result of f (), or to the exception it throws, and
+     * completes it.
+     */
+    template <class T, class F>
+    void fulfil (future_state <T> & s, F && f)
+    {
+        try {
+            s.emplace (f ());
+        } catch (...) {
+            s.error = std::current_exception ();
+        }
+        s.complete ();
+    }
+
+    template <class F>
+    void fulfil (future_state <void> & s, F && f)
+    {
+        try {
+            f ();
+        } catch (...) {
+            s.error = std::current_exception ();
+        }
+        s.complete ();
+    }
+
+    template <class F, class T>
+    struct then_result
+    {
+        using type = decltype (
+            utility::invoke (std::declval <F &> (), std::declval <T> ())
+        );
+    };
+
+    template <class F>
+    struct then_result <F, void>
+    {
+        using type = decltype (utility::invoke (std::declval <F &> ()));
+    };
+
+    template <class F, class T>
+    using then_result_t = typename then_result <
+        typename std::decay <F>::type, T
+    >::type;
+
+    template <class F, class T>
+    using complete_result_t = decltype (utility::invoke (
+        std::declval <typename std::decay <F>::type &> (),
+        std::declval <future <T>> ()
+    ));
+
+    /*
+     * Calls f with the value of s; if s holds an exception instead, take
+     * rethrows it and f is never called, so that fulfil passes the exception
+     * on down the chain.
+     */
+    template <class F, class T>
+    auto call_with (F & f, future_state <T> & s)
+        -> decltype (utility::invoke (f, s.take ()))
+    {
+        return utility::invoke (f, s.take ());
+    }
+
+    template <class F>
+    auto call_with (F & f, future_state <void> & s)
+        -> decltype (utility::invoke (f))
+    {
+        s.take ();
+        return utility::invoke (f);
+    }
+
+    template <class R, class F>
+    struct async_call
+    {
+        std::shared_ptr <future_state <R>> dst;
+        F f;
+
+        template <class ... Args>
+        void operator() (Args && ... args)
+        {
+            fulfil (*this->dst, [&] (void) {
+                return utility::invoke (
+                    std::move (this->f), std::forward <Args> (args)...
+                );
+            });
+        }
+    };
+
+    template <class T, class R, class F>
+    struct then_call
+    {
+        future_state <T> * src;
+        std::shared_ptr <future_state <R>> dst;
+        F f;
+
+        void operator() (void)
+        {
+            fulfil (*this->dst, [this] (void) {
+                return call_with (this->f, *this->src);
+            });
+        }
+    };
+
+    struct future_access
+    {
+        template <class T>
+        static future <T> make (std::shared_ptr <future_state <T>> s) noexcept
+        {
+            return future <T> (std::move (s));
+        }
+
+        template <class T>
+        static std::shared_ptr <future_state <T>> const &
+            state (future <T> const & f)
+        {
+            if (!f.state_)
+                throw std::logic_error ("future has no state");
+            return f.state_;
+        }
+
+        /*
+         * A new future sharing s, which must be owned by a shared_ptr.
+         */
+        template <class T>
+        static future <T> share (future_state <T> & s)
+        {
+            return future <T> (std::static_pointer_cast <future_state <T>> (
+                s.shared_from_this ()
+            ));
+        }
+    };
+
+    template <class T, class R, class F>
+    struct complete_call
+    {
+        future_state <T> * src;
+        std::shared_ptr <future_state <R>> dst;
+        F f;
+
+        void operator() (void)
+        {
+            fulfil (*this->dst, [this] (void) {
+                return utility::invoke (
+                    this->f, future_access::share (*this->src)
+                );
+            });
+        }
+    };
+
+    /*
+     * The inputs are not owned by the context, whose continuations they in
+     * turn own; instead each input is handed over, as a future, by its own
+     * continuation once it is ready, and the last one to arrive moves them
+     * all into the combined future.
+     */
+    template <class Sequence>
+    struct when_all_context
+    {
+        std::atomic_size_t pending;
+        Sequence inputs;
+        std::shared_ptr <future_state <Sequence>> dst;
+    };
+
+    template <class Sequence, class T>
+    struct when_all_call
+    {
+        std::shared_ptr <when_all_context <Sequence>> ctx;
+        future <T> * slot;
+        future_state <T> * src;
+
+        void operator() (void)
+        {
+            *this->slot = future_access::share (*this->src);
+            if (this->ctx->pending.fetch_sub (1) == 1) {
+                this->ctx->dst->emplace (std::move (this->ctx->inputs));
+                this->ctx->dst->complete ();
+            }
+        }
+    };
+
+    template <class Sequence, class T>
+    void when_all_attach (
+        std::shared_ptr <when_all_context <Sequence>> const & ctx,
+        future <T> & slot, future <T> const & input)
+    {
+        auto const & s = future_access::state (input);
+        s->on_ready (task_access::make_detached (
+            when_all_call <Sequence, T> {ctx, &slot, s.get ()}
+        ));
+    }
+
+    template <class ... Ts, std::size_t ... I>
+    void when_all_attach (
+        std::shared_ptr <when_all_context <std::tuple <future <Ts>...>>>
+            const & ctx,
+        std::tuple <future <Ts>...> const & inputs,
+        utility::index_sequence <I...>)
+    {
+        using expand = int [];
+        (void) expand {0, (when_all_attach (
+            ctx, std::get <I> (ctx->inputs), std::get <I> (inputs)
+        ), 0)...};
+    }
+
+    /*
+     * Only weak references to the inputs are kept until the first of them
+     * is ready, for the same reason. The others are then moved into the
+     * combined future, along with the result itself, so that the context
+     * is left holding neither.
+     */
+    template <class T>
+    struct when_any_context
+    {
+        std::atomic_bool fired {false};
+        std::vector <std::weak_ptr <future_state <T>>> inputs;
+        std::shared_ptr <
+            future_state <when_any_result <std::vector <future <T>>>>
+        > dst;
+    };
+
+    template <class T>
+    struct when_any_call
+    {
+        std::shared_ptr <when_any_context <T>> ctx;
+        std::size_t index;
+
+        void operator() (void)
+        {
+            if (this->ctx->fired.exchange (true))
+                return;
+
+            std::vector <future <T>> futures;
+            futures.reserve (this->ctx->inputs.size ());
+            for (auto const & w : this->ctx->inputs)
+                futures.emplace_back (future_access::make (w.lock ()));
+            this->ctx->inputs.clear ();
+
+            auto const dst = std::move (this->ctx->dst);
+            dst->emplace (when_any_result <std::vector <future <T>>> {
+                this->index, std::move (futures)
+            });
+            dst->complete ();
+        }
+    };
+}   // namespace detail
+
+    /*
+     * future; the result of a computation scheduled on a task_system by
+     * dsa::async, to which further work can be attached with then, when_all,
+     * and when_any. Attached work is pushed onto the same task_system as
+     * soon as its inputs are ready, so that no thread has to block waiting
+     * for them.
+     *
+     * Like std::future, a future is move-only and its value can be taken
+     * only once: get and then both consume the future, leaving it invalid.
+     * get blocks until the value is ready and is meant for the thread that
+     * consumes the final result of a chain, not for use inside tasks.
+     */
+    template <class T>
+    class future
+    {
+        static_assert (!std::is_reference <T>::value,
+                       "dsa::future does not support reference types");
+
+        std::shared_ptr <detail::future_state <T>> state_;
+
+        friend struct detail::future_access;
+
+        explicit future (std::shared_ptr <detail::future_state <T>> s) noexcept
+            : state_ (std::move (s))
+        {}
+
+    public:
+        using value_type = T;
+
+        future (void) noexcept
+            : state_ {}
+        {}
+
+        future (future const &) = delete;
+        future (future &&) noexcept = default;
+        future & operator= (future const &) = delete;
+        future & operator= (future &&) noexcept = default;
+
+        bool valid (void) const noexcept
+        {
+            return this->state_ != nullptr;
+        }
+
+        bool is_ready (void) const
+        {
+            return detail::future_access::state (*this)->is_ready ();
+        }
+
+        void wait (void) const
+        {
+            detail::future_access::state (*this)->wait ();
+        }
+
+        /*
+         * Waits for the value and returns it, or rethrows the exception the
+         * computation ended with.
+         */
+        T get (void)
+        {
+            auto s = detail::future_access::state (*this);
+            this->state_.reset ();
+            s->wait ();
+            return s->take ();
+        }
+
+        /*
+         * Schedules f (value), or f () for a future <void>, to run once this
+         * future is ready, and returns the future of its result. If this
+         * future ends with an exception, f is not called and the returned
+         * future ends with the same exception.
+         */
+        template <class F>
+        auto then (F && f) -> future <detail::then_result_t <F, T>>
+        {
+            using result_type = detail::then_result_t <F, T>;
+            using call_type = detail::then_call <
+                T, result_type, typename std::decay <F>::type
+            >;
+
+            auto src = detail::future_access::state (*this);
+            this->state_.reset ();
+
+            auto dst = std::make_shared <detail::future_state <result_type>> (
+                src->exec
+            );
+            src->on_ready (detail::task_access::make_detached (
+                call_type {src.get (), dst, std::forward <F> (f)}
+            ));
+            return detail::future_access::make (std::move (dst));
+        }
+
+        /*
+         * As then, but f is passed this future itself, once ready, instead
+         * of its value; it is called whether the future ends with a value
+         * or with an exception, which get then returns or rethrows.
+         */
+        template <class F>
+        auto on_complete (F && f)
+            -> future <detail::complete_result_t <F, T>>
+        {
+            using result_type = detail::complete_result_t <F, T>;
+            using call_type = detail::complete_call <
+                T, result_type, typename std::decay <F>::type
+            >;
+
+            auto src = detail::future_access::state (*this);
+            this->state_.reset ();
+
+            auto dst = std::make_shared <detail::future_state <result_type>> (
+                src->exec
+            );
+            src->on_ready (detail::task_access::make_detached (
+                call_type {src.get (), dst, std::forward <F> (f)}
+            ));
+            return detail::future_access::make (std::move (dst));
+        }
+    };
+
+    /*
+     * async; runs f (args...) on system and returns a future of the result.
+     * Arguments are decay-copied as for task_system::push.
+     */
+    template <class System, class F, class ... Args>
+    future <detail::task_result_t <F, Args...>>
+        async (System & system, F && f, Args && ... args)
+    {
+        using result_type = detail::task_result_t <F, Args...>;
+        using call_type = detail::async_call <
+            result_type, typename std::decay <F>::type
+        >;
+
+        auto dst = std::make_shared <detail::future_state <result_type>> (
+            detail::executor::of (system)
+        );
+        system.post (call_type {dst, std::forward <F> (f)},
+                     std::forward <Args> (args)...);
+        return detail::future_access::make (std::move (dst));
+    }
+
+    /*
+     * when_all; moves the futures in [first, last) into a vector and returns
+     * a future of that vector, ready once all of them are. Exceptions stay
+     * with the input they belong to. The combined future schedules its
+     * continuations where the first input does; the range must not be
+     * empty.
+     */
+    template <class InputIt>
+    auto when_all (InputIt first, InputIt last)
+        -> future <std::vector <
+            typename std::iterator_traits <InputIt>::value_type
+        >>
+    {
+        using sequence_type = std::vector <
+            typename std::iterator_traits <InputIt>::value_type
+        >;
+        using access = detail::future_access;
+
+        sequence_type inputs;
+        for (; first != last; ++first)
+            inputs.emplace_back (std::move (*first));
+        if (inputs.empty ())
+            throw std::invalid_argument ("when_all of an empty range");
+
+        /*
+         * Check every input before attaching to any of them.
+         */
+        for (auto const & f : inputs)
+            access::state (f);
+
+        auto ctx = std::make_shared <
+            detail::when_all_context <sequence_type>
+        > ();
+        ctx->inputs.resize (inputs.size ());
+        ctx->pending.store (inputs.size ());
+        ctx->dst = std::make_shared <detail::future_state <sequence_type>> (
+            access::state (inputs.front ())->exec
+        );
+        auto result = access::make (ctx->dst);
+
+        for (std::size_t k = 0; k < inputs.size (); ++k)
+            detail::when_all_attach (ctx, ctx->inputs [k], inputs [k]);
+        return result;
+    }
+
+    /*
+     * As above, for futures of possibly different types; the combined future
+     * holds them as a tuple.
+     */
+    template <class ... Ts>
+    future <std::tuple <future <Ts>...>> when_all (future <Ts> ... fs)
+    {
+        static_assert (sizeof... (Ts) > 0, "when_all requires an input");
+
+        using sequence_type = std::tuple <future <Ts>...>;
+        using access = detail::future_access;
+
+        detail::executor const execs [] = {access::state (fs)->exec...};
+        sequence_type const inputs (std::move (fs)...);
+
+        auto ctx = std::make_shared <
+            detail::when_all_context <sequence_type>
+        > ();
+        ctx->pending.store (sizeof... (Ts));
+        ctx->dst = std::make_shared <detail::future_state <sequence_type>> (
+            execs [0]
+        );
+        auto result = access::make (ctx->dst);
+
+        detail::when_all_attach (
+            ctx, inputs, utility::make_index_sequence <sizeof... (Ts)> {}
+        );
+        return result;
+    }
+
+    /*
+     * when_any; moves the futures in [first, last) into a vector and returns
+     * a future of a when_any_result, ready as soon as any one of them is.
+     * As for when_all, the range must not be empty. An input that had been
+     * abandoned by then, its state no longer kept by anything that could
+     * complete it, is left invalid in the result.
+     */
+    template <class InputIt>
+    auto when_any (InputIt first, InputIt last)
+        -> future <when_any_result <std::vector <
+            typename std::iterator_traits <InputIt>::value_type
+        >>>
+    {
+        using value_type = typename std::iterator_traits <
+            InputIt
+        >::value_type::value_type;
+        using sequence_type = std::vector <future <value_type>>;
+        using access = detail::future_access;
+
+        sequence_type inputs;
+        for (; first != last; ++first)
+            inputs.emplace_back (std::move (*first));
+        if (inputs.empty ())
+            throw std::invalid_argument ("when_any of an empty range");
+
+        auto ctx = std::make_shared <
+            detail::when_any_context <value_type>
+        > ();
+        for (auto const & f : inputs)
+            ctx->inputs.emplace_back (access::state (f));
+
+        ctx->dst = std::make_shared <
+            detail::future_state <when_any_result <sequence_type>>
+        > (access::state (inputs.front ())->exec);
+        auto result = access::make (ctx->dst);
+
+        for (std::size_t k = 0; k < inputs.size (); ++k)
+            access::state (inputs [k])->on_ready (
+                detail::task_access::make_detached (
+                    detail::when_any_call <value_type> {ctx, k}
+                )
+            );
+        return result;
+    }
+}   // namespace dsa
+
+#endif  // #ifndef DSA_FUTURE_HPP
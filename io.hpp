@@ -0,0 +1,1181 @@
+//
+// dsa is a utility library of data structures and algorithms built with C++11.
+// This file (io.hpp) is part of the dsa project.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+
+#ifndef DSA_IO_HPP
+#define DSA_IO_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "task.hpp"
+#include "future.hpp"
+#include "blocking.hpp"
+
+/*
+ * Defined on Linux when the io_uring headers are recent enough (5.7), unless
+ * DSA_NO_IO_URING is defined; file_reader then reads through io_uring
+ * whenever the running kernel allows it. Without it, or when the kernel
+ * refuses, reads are plain blocking calls on a blocking_executor.
+ */
+#if defined(__linux__) && !defined(DSA_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_FAST_POLL)
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define DSA_IO_URING 1
+#endif
+#endif
+#endif
+
+
+namespace dsa
+{
+    class file_buffer;
+
+namespace detail
+{
+    /*
+     * buffer_pool; fixed-size read buffers carved from one allocation, so
+     * that reading a small file allocates nothing and, under io_uring, the
+     * buffers can be registered with the kernel once up front.
+     */
+    struct buffer_pool
+    {
+        std::size_t slot_size;
+        std::size_t count;
+        std::unique_ptr <char []> memory;
+        std::mutex mutex;
+        std::vector <unsigned> free;
+
+        buffer_pool (std::size_t size, std::size_t n)
+            : slot_size {size}
+            , count {n}
+            , memory {new char [size * n]}
+        {
+            this->free.reserve (n);
+            for (std::size_t i = n; i-- > 0;)
+                this->free.push_back (static_cast <unsigned> (i));
+        }
+
+        char * slot (unsigned i) const noexcept
+        {
+            return this->memory.get () + i * this->slot_size;
+        }
+
+        bool acquire (unsigned & i)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex);
+            if (this->free.empty ())
+                return false;
+            i = this->free.back ();
+            this->free.pop_back ();
+            return true;
+        }
+
+        void release (unsigned i)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex);
+            this->free.push_back (i);
+        }
+    };
+
+    struct file_buffer_access;
+}   // namespace detail
+
+    /*
+     * file_buffer; the contents of a file read by file_reader. Small files
+     * land in a slot of the reader's buffer pool, which is handed back when
+     * the file_buffer is destroyed, and larger ones in an allocation of
+     * their own. Move-only.
+     */
+    class file_buffer
+    {
+        std::shared_ptr <detail::buffer_pool> pool_;
+        unsigned slot_ {0};
+        std::unique_ptr <char []> heap_;
+        char * data_ {nullptr};
+        std::size_t size_ {0};
+
+        friend struct detail::file_buffer_access;
+
+        void reset (void) noexcept
+        {
+            if (this->pool_)
+                this->pool_->release (this->slot_);
+            this->pool_.reset ();
+            this->heap_.reset ();
+            this->data_ = nullptr;
+            this->size_ = 0;
+        }
+
+    public:
+        file_buffer (void) noexcept = default;
+
+        file_buffer (file_buffer const &) = delete;
+        file_buffer & operator= (file_buffer const &) = delete;
+
+        file_buffer (file_buffer && other) noexcept
+            : pool_ {std::move (other.pool_)}
+            , slot_ {other.slot_}
+            , heap_ {std::move (other.heap_)}
+            , data_ {other.data_}
+            , size_ {other.size_}
+        {
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        file_buffer & operator= (file_buffer && other) noexcept
+        {
+            if (this != &other) {
+                this->reset ();
+                this->pool_ = std::move (other.pool_);
+                this->slot_ = other.slot_;
+                this->heap_ = std::move (other.heap_);
+                this->data_ = other.data_;
+                this->size_ = other.size_;
+                other.data_ = nullptr;
+                other.size_ = 0;
+            }
+            return *this;
+        }
+
+        ~file_buffer (void)
+        {
+            this->reset ();
+        }
+
+        char const * data (void) const noexcept
+        {
+            return this->data_;
+        }
+
+        std::size_t size (void) const noexcept
+        {
+            return this->size_;
+        }
+
+        bool empty (void) const noexcept
+        {
+            return this->size_ == 0;
+        }
+
+        char const * begin (void) const noexcept
+        {
+            return this->data_;
+        }
+
+        char const * end (void) const noexcept
+        {
+            return this->data_ + this->size_;
+        }
+    };
+
+    /*
+     * mapped_file; a whole file mapped read-only into memory and advised for
+     * sequential access, so that it can be scanned in place, with the
+     * kernel reading ahead, instead of being copied into a buffer first.
+     * Move-only; the mapping is removed on destruction.
+     */
+    class mapped_file
+    {
+        void * addr_ {nullptr};
+        std::size_t size_ {0};
+
+        void reset (void) noexcept
+        {
+            if (this->addr_)
+                ::munmap (this->addr_, this->size_);
+            this->addr_ = nullptr;
+            this->size_ = 0;
+        }
+
+    public:
+        mapped_file (void) noexcept = default;
+
+        /*
+         * Maps the first size bytes of the open file fd, which the caller
+         * may close afterwards. Throws std::system_error on failure.
+         */
+        mapped_file (int fd, std::size_t size)
+            : size_ {size}
+        {
+            if (size == 0)
+                return;
+
+            auto const p = ::mmap (nullptr, size, PROT_READ, MAP_PRIVATE,
+                                   fd, 0);
+            if (p == MAP_FAILED)
+                throw std::system_error (
+                    errno, std::system_category (), "mmap"
+                );
+            ::madvise (p, size, MADV_SEQUENTIAL);
+            this->addr_ = p;
+        }
+
+        /*
+         * Maps the whole of the file at path.
+         */
+        explicit mapped_file (std::string const & path)
+        {
+            int const fd = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::system_error (
+                    errno, std::system_category (), "failed to open " + path
+                );
+
+            struct ::stat st;
+            if (::fstat (fd, &st) != 0) {
+                int const err = errno;
+                ::close (fd);
+                throw std::system_error (
+                    err, std::system_category (), "failed to stat " + path
+                );
+            }
+
+            try {
+                *this = mapped_file {fd, static_cast <std::size_t> (
+                    st.st_size
+                )};
+            } catch (...) {
+                ::close (fd);
+                throw;
+            }
+            ::close (fd);
+        }
+
+        mapped_file (mapped_file const &) = delete;
+        mapped_file & operator= (mapped_file const &) = delete;
+
+        mapped_file (mapped_file && other) noexcept
+            : addr_ {other.addr_}
+            , size_ {other.size_}
+        {
+            other.addr_ = nullptr;
+            other.size_ = 0;
+        }
+
+        mapped_file & operator= (mapped_file && other) noexcept
+        {
+            if (this != &other) {
+                this->reset ();
+                this->addr_ = other.addr_;
+                this->size_ = other.size_;
+                other.addr_ = nullptr;
+                other.size_ = 0;
+            }
+            return *this;
+        }
+
+        ~mapped_file (void)
+        {
+            this->reset ();
+        }
+
+        char const * data (void) const noexcept
+        {
+            return static_cast <char const *> (this->addr_);
+        }
+
+        std::size_t size (void) const noexcept
+        {
+            return this->size_;
+        }
+
+        char const * begin (void) const noexcept
+        {
+            return this->data ();
+        }
+
+        char const * end (void) const noexcept
+        {
+            return this->data () + this->size_;
+        }
+    };
+
+namespace detail
+{
+    struct file_buffer_access
+    {
+        /*
+         * A buffer for size bytes: a pool slot when one is free and large
+         * enough, with its index in slot, and an allocation otherwise.
+         */
+        static file_buffer make (std::shared_ptr <buffer_pool> const & pool,
+                                 std::size_t size, bool & pooled,
+                                 unsigned & slot)
+        {
+            file_buffer b;
+            pooled = size <= pool->slot_size && pool->acquire (slot);
+            if (pooled) {
+                b.pool_ = pool;
+                b.slot_ = slot;
+                b.data_ = pool->slot (slot);
+            } else {
+                b.heap_.reset (new char [size]);
+                b.data_ = b.heap_.get ();
+            }
+            b.size_ = size;
+            return b;
+        }
+
+        static char * data (file_buffer & b) noexcept
+        {
+            return b.data_;
+        }
+
+        /*
+         * For files that turn out shorter than they were when opened.
+         */
+        static void truncate (file_buffer & b, std::size_t size) noexcept
+        {
+            b.size_ = size;
+        }
+    };
+
+    inline std::system_error read_error (int err, std::string const & path)
+    {
+        return std::system_error (
+            err, std::system_category (), "failed to read file " + path
+        );
+    }
+
+    /*
+     * The fallback; opens, sizes, and reads path with ordinary blocking
+     * calls.
+     */
+    inline file_buffer read_blocking (
+        std::string const & path, std::shared_ptr <buffer_pool> const & pool)
+    {
+        int const fd = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw read_error (errno, path);
+
+        struct ::stat st;
+        if (::fstat (fd, &st) != 0) {
+            int const err = errno;
+            ::close (fd);
+            throw read_error (err, path);
+        }
+
+        bool pooled;
+        unsigned slot;
+        auto buf = file_buffer_access::make (
+            pool, static_cast <std::size_t> (st.st_size), pooled, slot
+        );
+
+        std::size_t done = 0;
+        while (done < buf.size ()) {
+            auto const n = ::pread (
+                fd, file_buffer_access::data (buf) + done, buf.size () - done,
+                static_cast <off_t> (done)
+            );
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                int const err = errno;
+                ::close (fd);
+                throw read_error (err, path);
+            }
+            if (n == 0)
+                break;
+            done += static_cast <std::size_t> (n);
+        }
+
+        ::close (fd);
+        file_buffer_access::truncate (buf, done);
+        return buf;
+    }
+
+#ifdef DSA_IO_URING
+    /*
+     * uring; a minimal io_uring instance driven through the raw system
+     * calls: the submission and completion rings mapped into memory, with
+     * one thread as the only producer of submissions and the only consumer
+     * of completions.
+     */
+    class uring
+    {
+        int fd_ {-1};
+        void * sq_ring_ {nullptr};
+        void * cq_ring_ {nullptr};
+        std::size_t sq_ring_size_ {0};
+        std::size_t cq_ring_size_ {0};
+        io_uring_sqe * sqes_ {nullptr};
+        std::size_t sqes_size_ {0};
+
+        unsigned * sq_tail_ {nullptr};
+        unsigned sq_mask_ {0};
+        unsigned * sq_array_ {nullptr};
+        unsigned * cq_head_ {nullptr};
+        unsigned * cq_tail_ {nullptr};
+        unsigned cq_mask_ {0};
+        io_uring_cqe * cqes_ {nullptr};
+
+        unsigned entries_ {0};
+        unsigned pending_ {0};
+
+        static unsigned * at (void * ring, unsigned offset) noexcept
+        {
+            return reinterpret_cast <unsigned *> (
+                static_cast <char *> (ring) + offset
+            );
+        }
+
+        static void * map (int fd, std::size_t size, off_t offset) noexcept
+        {
+            auto const p = ::mmap (nullptr, size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, fd, offset);
+            return p == MAP_FAILED ? nullptr : p;
+        }
+
+    public:
+        uring (void) noexcept = default;
+
+        uring (uring const &) = delete;
+        uring & operator= (uring const &) = delete;
+
+        ~uring (void)
+        {
+            this->close ();
+        }
+
+        /*
+         * Unmaps the rings and closes the instance, which cancels whatever
+         * it still has in flight; a closed ring may be closed again.
+         */
+        void close (void) noexcept
+        {
+            if (this->sqes_)
+                ::munmap (this->sqes_, this->sqes_size_);
+            if (this->cq_ring_ && this->cq_ring_ != this->sq_ring_)
+                ::munmap (this->cq_ring_, this->cq_ring_size_);
+            if (this->sq_ring_)
+                ::munmap (this->sq_ring_, this->sq_ring_size_);
+            if (this->fd_ >= 0)
+                ::close (this->fd_);
+            this->fd_ = -1;
+            this->sqes_ = nullptr;
+            this->sq_ring_ = this->cq_ring_ = nullptr;
+        }
+
+        /*
+         * Sets up a ring of at least the given number of entries; false if
+         * the kernel does not allow it (too old, or io_uring disabled).
+         */
+        bool open (unsigned entries) noexcept
+        {
+            io_uring_params p;
+            std::memset (&p, 0, sizeof (p));
+            auto const fd = ::syscall (__NR_io_uring_setup, entries, &p);
+            if (fd < 0)
+                return false;
+            this->fd_ = static_cast <int> (fd);
+
+            this->sq_ring_size_ =
+                p.sq_off.array + p.sq_entries * sizeof (unsigned);
+            this->cq_ring_size_ =
+                p.cq_off.cqes + p.cq_entries * sizeof (io_uring_cqe);
+            bool const single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) {
+                this->sq_ring_size_ = this->cq_ring_size_ = std::max (
+                    this->sq_ring_size_, this->cq_ring_size_
+                );
+            }
+
+            this->sq_ring_ = map (this->fd_, this->sq_ring_size_,
+                                  IORING_OFF_SQ_RING);
+            this->cq_ring_ = single ? this->sq_ring_ :
+                map (this->fd_, this->cq_ring_size_, IORING_OFF_CQ_RING);
+            this->sqes_size_ = p.sq_entries * sizeof (io_uring_sqe);
+            this->sqes_ = static_cast <io_uring_sqe *> (
+                map (this->fd_, this->sqes_size_, IORING_OFF_SQES)
+            );
+            if (!this->sq_ring_ || !this->cq_ring_ || !this->sqes_) {
+                this->close ();
+                return false;
+            }
+
+            this->sq_tail_ = at (this->sq_ring_, p.sq_off.tail);
+            this->sq_mask_ = *at (this->sq_ring_, p.sq_off.ring_mask);
+            this->sq_array_ = at (this->sq_ring_, p.sq_off.array);
+            this->cq_head_ = at (this->cq_ring_, p.cq_off.head);
+            this->cq_tail_ = at (this->cq_ring_, p.cq_off.tail);
+            this->cq_mask_ = *at (this->cq_ring_, p.cq_off.ring_mask);
+            this->cqes_ = reinterpret_cast <io_uring_cqe *> (
+                static_cast <char *> (this->cq_ring_) + p.cq_off.cqes
+            );
+            this->entries_ = p.sq_entries;
+            return true;
+        }
+
+        unsigned entries (void) const noexcept
+        {
+            return this->entries_;
+        }
+
+        /*
+         * Whether the kernel implements every one of the given operations.
+         */
+        bool supports (std::initializer_list <unsigned> ops) const
+        {
+            constexpr unsigned n = 256;
+            std::vector <unsigned char> memory (
+                sizeof (io_uring_probe) + n * sizeof (io_uring_probe_op)
+            );
+            auto const probe = reinterpret_cast <io_uring_probe *> (
+                memory.data ()
+            );
+            if (::syscall (__NR_io_uring_register, this->fd_,
+                           IORING_REGISTER_PROBE, probe, n) < 0)
+                return false;
+
+            for (auto op : ops)
+                if (op > probe->last_op ||
+                    !(probe->ops [op].flags & IO_URING_OP_SUPPORTED))
+                    return false;
+            return true;
+        }
+
+        /*
+         * Registers count buffers of size bytes each, starting at base, for
+         * IORING_OP_READ_FIXED; false if the kernel refuses, typically for
+         * want of locked memory.
+         */
+        bool register_buffers (char * base, std::size_t size,
+                               std::size_t count)
+        {
+            std::vector <iovec> iov (count);
+            for (std::size_t i = 0; i < count; ++i) {
+                iov [i].iov_base = base + i * size;
+                iov [i].iov_len = size;
+            }
+            return ::syscall (__NR_io_uring_register, this->fd_,
+                              IORING_REGISTER_BUFFERS, iov.data (),
+                              static_cast <unsigned> (count)) == 0;
+        }
+
+        /*
+         * The next free submission entry, zeroed; the caller fills it in and
+         * calls commit. At most entries () may be prepared between calls to
+         * submit_and_wait.
+         */
+        io_uring_sqe * prepare (void) noexcept
+        {
+            auto const index = *this->sq_tail_ & this->sq_mask_;
+            auto const sqe = &this->sqes_ [index];
+            std::memset (sqe, 0, sizeof (*sqe));
+            this->sq_array_ [index] = index;
+            return sqe;
+        }
+
+        void commit (void) noexcept
+        {
+            __atomic_store_n (this->sq_tail_, *this->sq_tail_ + 1,
+                              __ATOMIC_RELEASE);
+            this->pending_++;
+        }
+
+        /*
+         * Submits everything committed so far, in a single system call, and
+         * waits for at least one completion.
+         */
+        void submit_and_wait (void)
+        {
+            while (true) {
+                auto const r = ::syscall (
+                    __NR_io_uring_enter, this->fd_, this->pending_, 1u,
+                    IORING_ENTER_GETEVENTS, nullptr, 0
+                );
+                if (r >= 0) {
+                    this->pending_ -= static_cast <unsigned> (r);
+                    if (this->pending_ == 0)
+                        return;
+                } else if (errno != EINTR && errno != EAGAIN &&
+                           errno != EBUSY) {
+                    throw std::system_error (
+                        errno, std::system_category (), "io_uring_enter"
+                    );
+                }
+            }
+        }
+
+        /*
+         * Calls f (user_data, res) for every completion that has arrived.
+         */
+        template <class F>
+        void drain (F && f)
+        {
+            auto head = *this->cq_head_;
+            auto const tail = __atomic_load_n (this->cq_tail_,
+                                               __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                auto const & cqe = this->cqes_ [head & this->cq_mask_];
+                f (cqe.user_data, cqe.res);
+            }
+            __atomic_store_n (this->cq_head_, head, __ATOMIC_RELEASE);
+        }
+    };
+#endif  // #ifdef DSA_IO_URING
+}   // namespace detail
+
+    /*
+     * file_reader; reads whole files and hands their contents to a dsa::future
+     * whose continuations run on a task_system:
+     *
+     *      dsa::file_reader reader;
+     *      reader.read (compute, path).then ([] (dsa::file_buffer b) { ... });
+     *
+     * Under io_uring (see DSA_IO_URING) one thread owns the ring. Requests
+     * pile up while it waits, and each time it wakes it submits all of them
+     * at once, opening and sizing files, then reading them into the
+     * registered buffers of the pool (or, for files too large for a slot,
+     * into allocations of their own) with at most depth operations in
+     * flight. A read costs no system call of its own beyond a close, and no
+     * thread blocks on the disk. The continuation is pushed as each read
+     * completes. Should the ring itself fail, every read still in it fails
+     * with that error, and later ones are made as below.
+     *
+     * Elsewhere, or when the kernel refuses io_uring, each read is a
+     * blocking open, fstat, and pread on a blocking_executor; the future and
+     * pooled buffers are the same, so callers do not need to tell the two
+     * apart. A file that cannot be opened or read fails its future with a
+     * std::system_error.
+     *
+     * The pool's buffers go back to it as their file_buffers are destroyed;
+     * when none is free a file is read into an allocation instead, so reads
+     * never wait for buffers to be returned.
+     */
+    class file_reader
+    {
+        using fallback_type = blocking_executor <>;
+        using fallback_allocator =
+            detail::cache_aligned_allocator <fallback_type>;
+
+        /*
+         * The fallback executor is over-aligned, which plain new does not
+         * honour before C++17.
+         */
+        struct fallback_deleter
+        {
+            void operator() (fallback_type * p) const noexcept
+            {
+                p->~fallback_type ();
+                fallback_allocator {}.deallocate (p, 1);
+            }
+        };
+
+        using fallback_pointer =
+            std::unique_ptr <fallback_type, fallback_deleter>;
+
+        static fallback_pointer make_fallback (void)
+        {
+            fallback_allocator alloc;
+            auto const p = alloc.allocate (1);
+            try {
+                ::new (static_cast <void *> (p)) fallback_type {};
+            } catch (...) {
+                alloc.deallocate (p, 1);
+                throw;
+            }
+            return fallback_pointer {p};
+        }
+
+        std::shared_ptr <detail::buffer_pool> buffers_;
+
+        /*
+         * Made by the constructor when there is no ring, or by the first
+         * read after the ring has failed, under mutex_.
+         */
+        fallback_pointer fallback_;
+
+        /*
+         * The executor for reads that do not go through the ring: the one
+         * made up front, or else one made now that the ring has failed.
+         */
+        fallback_type & fallback (void)
+        {
+#ifdef DSA_IO_URING
+            if (this->thread_.joinable ()) {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                if (!this->fallback_)
+                    this->fallback_ = make_fallback ();
+                return *this->fallback_;
+            }
+#endif
+            return *this->fallback_;
+        }
+
+#ifdef DSA_IO_URING
+        struct request
+        {
+            std::string path;
+            std::shared_ptr <detail::future_state <file_buffer>> dst;
+            file_buffer buf;
+            struct ::statx stx;
+            int fd {-1};
+            std::size_t done {0};
+            std::size_t index {0};
+            bool started {false};
+            bool sized {false};
+            bool fixed {false};
+            unsigned slot {0};
+        };
+
+        /*
+         * The user_data of the completion of the read from wake_fd_, which
+         * no request pointer can equal.
+         */
+        static constexpr std::uint64_t wake_data = 0;
+
+        detail::uring ring_;
+        bool registered_ {false};
+        unsigned limit_ {0};
+        int wake_fd_ {-1};
+        std::uint64_t wake_value_ {0};
+
+        std::mutex mutex_;
+        std::condition_variable idle_cv_;
+        std::vector <request *> incoming_;
+        std::size_t outstanding_ {0};
+        bool sleeping_ {false};
+        bool stop_ {false};
+        std::thread thread_;
+
+        /* set, under mutex_, once the ring has failed */
+        std::atomic_bool broken_ {false};
+
+        /* the requests with an operation in flight; ring thread only */
+        std::vector <request *> active_;
+
+        bool open_ring (std::size_t depth)
+        {
+            if (!this->ring_.open (static_cast <unsigned> (depth) + 1))
+                return false;
+            if (!this->ring_.supports ({IORING_OP_OPENAT, IORING_OP_STATX,
+                                        IORING_OP_READ, IORING_OP_READ_FIXED}))
+                return false;
+
+            this->wake_fd_ = ::eventfd (0, EFD_CLOEXEC);
+            if (this->wake_fd_ < 0)
+                return false;
+
+            this->registered_ = this->ring_.register_buffers (
+                this->buffers_->memory.get (), this->buffers_->slot_size,
+                this->buffers_->count
+            );
+            /* one entry is kept back for the wake-up read */
+            this->limit_ = this->ring_.entries () - 1;
+            this->active_.reserve (this->limit_);
+            return true;
+        }
+
+        void wake (void) noexcept
+        {
+            std::uint64_t const one = 1;
+            auto const r = ::write (this->wake_fd_, &one, sizeof (one));
+            (void) r;
+        }
+
+        void prepare_wake (void) noexcept
+        {
+            auto const sqe = this->ring_.prepare ();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = this->wake_fd_;
+            sqe->addr = reinterpret_cast <std::uint64_t> (&this->wake_value_);
+            sqe->len = sizeof (this->wake_value_);
+            sqe->off = static_cast <std::uint64_t> (-1);
+            sqe->user_data = wake_data;
+            this->ring_.commit ();
+        }
+
+        /*
+         * Makes r active and opens its file; r must have been counted
+         * against limit_.
+         */
+        void start (request * r)
+        {
+            r->index = this->active_.size ();
+            this->active_.push_back (r);
+            r->started = true;
+            this->prepare_open (r);
+        }
+
+        void prepare_open (request * r) noexcept
+        {
+            auto const sqe = this->ring_.prepare ();
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast <std::uint64_t> (r->path.c_str ());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = reinterpret_cast <std::uint64_t> (r);
+            this->ring_.commit ();
+        }
+
+        /*
+         * Sizes the file through its descriptor, for which statx takes an
+         * empty path.
+         */
+        void prepare_stat (request * r) noexcept
+        {
+            auto const sqe = this->ring_.prepare ();
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = r->fd;
+            sqe->addr = reinterpret_cast <std::uint64_t> ("");
+            sqe->len = STATX_SIZE;
+            sqe->off = reinterpret_cast <std::uint64_t> (&r->stx);
+            sqe->statx_flags = AT_EMPTY_PATH;
+            sqe->user_data = reinterpret_cast <std::uint64_t> (r);
+            this->ring_.commit ();
+        }
+
+        void prepare_read (request * r) noexcept
+        {
+            constexpr std::size_t max_len = std::size_t {1} << 30;
+            auto const remaining = r->buf.size () - r->done;
+
+            auto const sqe = this->ring_.prepare ();
+            sqe->opcode = r->fixed && this->registered_ ?
+                IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = r->fd;
+            sqe->addr = reinterpret_cast <std::uint64_t> (
+                detail::file_buffer_access::data (r->buf) + r->done
+            );
+            sqe->len = static_cast <unsigned> (std::min (remaining, max_len));
+            sqe->off = r->done;
+            sqe->buf_index = static_cast <std::uint16_t> (r->slot);
+            sqe->user_data = reinterpret_cast <std::uint64_t> (r);
+            this->ring_.commit ();
+        }
+
+        void finish (request * r, std::exception_ptr error) noexcept
+        {
+            if (r->fd >= 0)
+                ::close (r->fd);
+            if (r->started) {
+                auto const last = this->active_.back ();
+                this->active_ [r->index] = last;
+                last->index = r->index;
+                this->active_.pop_back ();
+            }
+
+            if (error) {
+                r->dst->error = std::move (error);
+            } else {
+                detail::file_buffer_access::truncate (r->buf, r->done);
+                r->dst->emplace (std::move (r->buf));
+            }
+            r->dst->complete ();
+            delete r;
+
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            if (--this->outstanding_ == 0)
+                this->idle_cv_.notify_all ();
+        }
+
+        void finish (request * r, int err) noexcept
+        {
+            this->finish (r, err == 0 ? std::exception_ptr {} :
+                std::make_exception_ptr (detail::read_error (err, r->path)));
+        }
+
+        /*
+         * Moves r on after the completion of its last operation, with result
+         * res, to its next operation or to its end.
+         */
+        void advance (request * r, int res)
+        {
+            if (r->fd < 0) {
+                if (res < 0) {
+                    this->finish (r, -res);
+                    return;
+                }
+
+                r->fd = res;
+                this->prepare_stat (r);
+                return;
+            }
+
+            if (!r->sized) {
+                if (res < 0) {
+                    this->finish (r, -res);
+                    return;
+                }
+
+                r->sized = true;
+                try {
+                    r->buf = detail::file_buffer_access::make (
+                        this->buffers_,
+                        static_cast <std::size_t> (r->stx.stx_size),
+                        r->fixed, r->slot
+                    );
+                } catch (std::bad_alloc const &) {
+                    this->finish (r, ENOMEM);
+                    return;
+                }
+            } else if (res == -EINTR || res == -EAGAIN) {
+                /* retried as it stands */
+            } else if (res < 0) {
+                this->finish (r, -res);
+                return;
+            } else if (res == 0) {
+                /* the file shrank since it was opened */
+                detail::file_buffer_access::truncate (r->buf, r->done);
+            } else {
+                r->done += static_cast <std::size_t> (res);
+            }
+
+            if (r->done >= r->buf.size ()) {
+                this->finish (r, 0);
+                return;
+            }
+
+            this->prepare_read (r);
+        }
+
+        /*
+         * After the ring has failed with error: closes it, which cancels
+         * what it still had in flight, and fails every request it holds or
+         * has yet to take. Reads from then on go to the fallback.
+         */
+        void abandon (std::deque <request *> & waiting,
+                      std::exception_ptr error) noexcept
+        {
+            this->ring_.close ();
+
+            std::vector <request *> incoming;
+            {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                this->broken_.store (true);
+                incoming.swap (this->incoming_);
+            }
+
+            while (!this->active_.empty ())
+                this->finish (this->active_.back (), error);
+            for (auto r : waiting)
+                this->finish (r, error);
+            for (auto r : incoming)
+                this->finish (r, error);
+        }
+
+        void run (void)
+        {
+            std::deque <request *> waiting;
+            bool armed = false;
+
+            try {
+                while (true) {
+                    bool stop;
+                    {
+                        std::unique_lock <std::mutex> lock (this->mutex_);
+                        waiting.insert (waiting.end (),
+                                        this->incoming_.begin (),
+                                        this->incoming_.end ());
+                        this->incoming_.clear ();
+                        this->sleeping_ = true;
+                        stop = this->stop_;
+                    }
+
+                    while (!waiting.empty () &&
+                           this->active_.size () < this->limit_)
+                    {
+                        this->start (waiting.front ());
+                        waiting.pop_front ();
+                    }
+
+                    if (stop && this->active_.empty () && waiting.empty () &&
+                        !armed)
+                        return;
+                    if (!stop && !armed) {
+                        this->prepare_wake ();
+                        armed = true;
+                    }
+
+                    this->ring_.submit_and_wait ();
+                    this->ring_.drain ([&] (std::uint64_t data, int res) {
+                        if (data == wake_data)
+                            armed = false;
+                        else
+                            this->advance (
+                                reinterpret_cast <request *> (data), res
+                            );
+                    });
+                }
+            } catch (...) {
+                this->abandon (waiting, std::current_exception ());
+            }
+        }
+
+        /*
+         * Hands r over to the ring thread; false, leaving r with the caller,
+         * once the ring has failed.
+         */
+        bool enqueue (std::unique_ptr <request> & r)
+        {
+            bool wake;
+            {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                if (this->broken_.load ())
+                    return false;
+                this->incoming_.push_back (r.get ());
+                r.release ();
+                this->outstanding_++;
+                wake = this->sleeping_;
+                this->sleeping_ = false;
+            }
+            if (wake)
+                this->wake ();
+            return true;
+        }
+#endif  // #ifdef DSA_IO_URING
+
+    public:
+        /*
+         * depth bounds the number of operations in flight at once; the pool
+         * holds buffers of buffer_size bytes each, for files no larger.
+         */
+        explicit file_reader (std::size_t depth = 256,
+                              std::size_t buffer_size = 64 * 1024,
+                              std::size_t buffers = 128)
+            : buffers_ {std::make_shared <detail::buffer_pool> (
+                  buffer_size, buffers
+              )}
+        {
+#ifdef DSA_IO_URING
+            if (this->open_ring (depth)) {
+                this->thread_ = std::thread {&file_reader::run, this};
+                return;
+            }
+            if (this->wake_fd_ >= 0)
+                ::close (this->wake_fd_);
+            this->wake_fd_ = -1;
+#endif
+            (void) depth;
+            this->fallback_ = make_fallback ();
+        }
+
+        file_reader (file_reader const &) = delete;
+        file_reader & operator= (file_reader const &) = delete;
+
+        /*
+         * Waits for every read already requested to complete.
+         */
+        ~file_reader (void)
+        {
+#ifdef DSA_IO_URING
+            if (this->thread_.joinable ()) {
+                {
+                    std::unique_lock <std::mutex> lock (this->mutex_);
+                    this->stop_ = true;
+                }
+                this->wake ();
+                this->thread_.join ();
+                ::close (this->wake_fd_);
+            }
+#endif
+        }
+
+        /*
+         * Reads the whole of the file at path; continuations of the returned
+         * future are scheduled on system.
+         */
+        template <class System>
+        future <file_buffer> read (System & system, std::string path)
+        {
+#ifdef DSA_IO_URING
+            if (this->thread_.joinable ()) {
+                auto dst = std::make_shared <
+                    detail::future_state <file_buffer>
+                > (detail::executor::of (system));
+                std::unique_ptr <request> r {new request};
+                r->path = std::move (path);
+                r->dst = dst;
+
+                if (this->enqueue (r))
+                    return detail::future_access::make (std::move (dst));
+                path = std::move (r->path);
+            }
+#endif
+            return this->fallback ().submit (
+                system, &detail::read_blocking, std::move (path),
+                this->buffers_
+            );
+        }
+
+        /*
+         * Waits until every read requested so far has completed; their
+         * continuations have then been pushed to their task_system, but may
+         * not have run.
+         */
+        void wait_idle (void)
+        {
+#ifdef DSA_IO_URING
+            if (this->thread_.joinable ()) {
+                fallback_type * f;
+                {
+                    std::unique_lock <std::mutex> lock (this->mutex_);
+                    while (this->outstanding_ != 0)
+                        this->idle_cv_.wait (lock);
+                    f = this->fallback_.get ();
+                }
+                if (f)
+                    f->wait_idle ();
+                return;
+            }
+#endif
+            this->fallback_->wait_idle ();
+        }
+
+        /*
+         * Whether reads go through io_uring rather than blocking calls.
+         */
+        bool uses_io_uring (void) const noexcept
+        {
+#ifdef DSA_IO_URING
+            return this->thread_.joinable () && !this->broken_.load ();
+#else
+            return false;
+#endif
+        }
+    };
+}   // namespace dsa
+
+#endif  // #ifndef DSA_IO_HPP
@@ -0,0 +1,499 @@
+//
+// dsa is a utility library of data structures and algorithms built with C++11.
+// This file (parallel.hpp) is part of the dsa project.
+//
+// author: Dalton Woodard
+// contact: daltonmwoodard@gmail.com
+// repository: https://github.com/daltonwoodard/task.git
+// license:
+//
+// Copyright (c) 2016 DaltonWoodard. See the COPYRIGHT.md file at the top-level
+// directory or at the listed source repository for details.
+//
+//      Licensed under the Apache License. Version 2.0:
+//          https://www.apache.org/licenses/LICENSE-2.0
+//      or the MIT License:
+//          https://opensource.org/licenses/MIT
+//      at the licensee's option. This file may not be copied, modified, or
+//      distributed except according to those terms.
+//
+
+#ifndef DSA_PARALLEL_HPP
+#define DSA_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "task.hpp"
+
+
+namespace dsa
+{
+namespace detail
+{
+    /*
+     * loop_state; the bookkeeping shared by every task of one parallel loop.
+     * Each range handed out is counted as pending until it has been processed,
+     * and the first exception thrown by the loop body is kept to be rethrown
+     * to the caller.
+     */
+    struct loop_state
+    {
+        std::atomic_size_t pending {0};
+        std::atomic_bool failed {false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done {false};
+
+        /*
+         * Set by a worker that waits for the state, which parks on its
+         * system's work eventcount and so must be woken through it.
+         */
+        std::atomic_bool waiting {false};
+        eventcount * wake {nullptr};
+
+        void add (void) noexcept
+        {
+            this->pending++;
+        }
+
+        void fail (std::exception_ptr e)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex);
+            if (!this->error)
+                this->error = std::move (e);
+            this->failed.store (true);
+        }
+
+        /*
+         * The last range to finish flags completion under the mutex; the
+         * waiter only returns after observing that flag under the same mutex,
+         * so the state is never destroyed while a finisher still uses it.
+         */
+        void finish (void)
+        {
+            if (this->pending.fetch_sub (1) == 1) {
+                auto const ec = this->waiting.load () ? this->wake : nullptr;
+                {
+                    std::unique_lock <std::mutex> lock (this->mutex);
+                    this->done = true;
+                    this->cv.notify_all ();
+                }
+                if (ec)
+                    ec->notify_all ();
+            }
+        }
+
+        /*
+         * A waiting worker keeps running tasks, the loop's own or otherwise,
+         * rather than blocking the thread the loop needs to make progress.
+         * With nothing left to run it parks with the idle workers, to be
+         * woken by the next push or by the last finish.
+         */
+        template <class System>
+        void wait (System & system)
+        {
+            using access = task_system_access <System>;
+
+            if (access::in_worker (system)) {
+                auto & work = access::work_available (system);
+                this->wake = &work;
+                this->waiting.store (true);
+                while (this->pending.load () != 0) {
+                    if (access::run_one (system))
+                        continue;
+
+                    auto const key = work.prepare_wait ();
+                    if (this->pending.load () == 0 ||
+                        access::queued (system) != 0)
+                        work.cancel_wait ();
+                    else
+                        work.commit_wait (key);
+                }
+            }
+
+            std::unique_lock <std::mutex> lock (this->mutex);
+            while (!this->done)
+                this->cv.wait (lock);
+
+            if (this->error)
+                std::rethrow_exception (this->error);
+        }
+    };
+
+    /*
+     * Runs [first, last) on the calling worker using lazy binary splitting
+     * (Tzannes et al., "Lazy Binary-Splitting", PPoPP '10): the range is
+     * consumed grain iterations at a time, and before each step, if the
+     * worker's own queue is empty -- so that an idle thief would find nothing
+     * to take -- the upper half of what remains is split off into a new task
+     * on that queue. Splitting thus only happens when there is demand for it,
+     * and stolen halves are split again on the thief in the same way.
+     *
+     * Context provides make_leaf (), returning the per-range accumulator,
+     * which is called with each index in turn and then with finish (first)
+     * once the range has been consumed.
+     */
+    template <class System, class Context, class Index>
+    void run_range (System & system, Context & ctx,
+                    Index first, Index last, Index grain)
+    {
+        using access = task_system_access <System>;
+
+        try {
+            auto leaf = ctx.make_leaf ();
+            auto i = first;
+            while (i < last && !ctx.failed.load (std::memory_order_relaxed)) {
+                if (last - i > grain && access::local_empty (system)) {
+                    auto const mid = i + (last - i) / 2;
+                    auto const end = last;
+                    ctx.add ();
+                    try {
+                        access::spawn_local (
+                            system, [&system, &ctx, mid, end, grain] (void) {
+                                run_range (system, ctx, mid, end, grain);
+                            }
+                        );
+                    } catch (...) {
+                        ctx.finish ();
+                        throw;
+                    }
+                    last = mid;
+                    continue;
+                }
+
+                auto const stop = last - i > grain ? i + grain : last;
+                for (; i < stop; ++i)
+                    leaf (i);
+            }
+
+            if (!ctx.failed.load ())
+                leaf.finish (first);
+        } catch (...) {
+            ctx.fail (std::current_exception ());
+        }
+
+        ctx.finish ();
+    }
+
+    /*
+     * Hands the whole range out as one initial piece per worker, so that
+     * every worker is woken with work of its own, and waits for the loop.
+     */
+    template <class System, class Context, class Index>
+    void run_loop (System & system, Context & ctx,
+                   Index first, Index last, Index grain)
+    {
+        using access = task_system_access <System>;
+
+        if (!(first < last))
+            return;
+        if (grain < Index (1))
+            grain = Index (1);
+
+        auto const n = last - first;
+        auto const workers = static_cast <Index> (
+            std::max <std::size_t> (1, access::concurrency (system))
+        );
+        auto pieces = (n + grain - 1) / grain;
+        if (workers < pieces)
+            pieces = workers;
+
+        auto const step = n / pieces;
+        auto const extra = n % pieces;
+        auto begin = first;
+
+        /*
+         * The loop holds a count of its own until every piece is out, so
+         * that a piece that fails to spawn only has its own count undone.
+         */
+        ctx.pending.store (1);
+        try {
+            for (Index k = 0; k < pieces; ++k) {
+                auto const end =
+                    begin + step + (k < extra ? Index (1) : Index (0));
+                ctx.add ();
+                try {
+                    access::spawn (
+                        system, [&system, &ctx, begin, end, grain] (void) {
+                            run_range (system, ctx, begin, end, grain);
+                        }
+                    );
+                } catch (...) {
+                    ctx.finish ();
+                    throw;
+                }
+                begin = end;
+            }
+        } catch (...) {
+            ctx.fail (std::current_exception ());
+        }
+        ctx.finish ();
+
+        ctx.wait (system);
+    }
+
+    template <class Body>
+    struct for_context : loop_state
+    {
+        struct leaf
+        {
+            Body & body;
+
+            template <class Index>
+            void operator() (Index i)
+            {
+                this->body (i);
+            }
+
+            template <class Index>
+            void finish (Index) noexcept
+            {}
+        };
+
+        Body & body;
+
+        explicit for_context (Body & b)
+            : body (b)
+        {}
+
+        leaf make_leaf (void)
+        {
+            return leaf {this->body};
+        }
+    };
+
+    template <class Index, class T, class Map, class Reduce>
+    struct reduce_context : loop_state
+    {
+        struct leaf
+        {
+            reduce_context & ctx;
+            T value;
+
+            void operator() (Index i)
+            {
+                this->value = this->ctx.map (std::move (this->value), i);
+            }
+
+            void finish (Index first)
+            {
+                std::unique_lock <std::mutex> lock (this->ctx.partials_mutex);
+                this->ctx.partials.emplace_back (first,
+                                                 std::move (this->value));
+            }
+        };
+
+        T const & identity;
+        Map & map;
+        Reduce & reduce;
+        std::mutex partials_mutex;
+        std::vector <std::pair <Index, T>> partials;
+
+        reduce_context (T const & id, Map & m, Reduce & r)
+            : identity (id)
+            , map      (m)
+            , reduce   (r)
+        {}
+
+        leaf make_leaf (void)
+        {
+            return leaf {*this, this->identity};
+        }
+
+        /*
+         * Partial results are combined in index order, so reduce need only be
+         * associative.
+         */
+        T result (void)
+        {
+            std::sort (
+                this->partials.begin (), this->partials.end (),
+                [] (std::pair <Index, T> const & a,
+                    std::pair <Index, T> const & b) {
+                    return a.first < b.first;
+                }
+            );
+
+            T acc = this->identity;
+            for (auto & p : this->partials)
+                acc = this->reduce (std::move (acc), std::move (p.second));
+            return acc;
+        }
+    };
+
+    /*
+     * One task of a task_group; skipped once another task of the group has
+     * thrown.
+     */
+    template <class F>
+    struct group_task
+    {
+        loop_state * state;
+        F fn;
+
+        void operator() (void)
+        {
+            try {
+                if (!this->state->failed.load (std::memory_order_relaxed))
+                    this->fn ();
+            } catch (...) {
+                this->state->fail (std::current_exception ());
+            }
+            this->state->finish ();
+        }
+    };
+}   // namespace detail
+
+    /*
+     * parallel_for; calls body (i) for every i in [first, last) on the
+     * workers of system, returning once all calls have completed. Ranges are
+     * divided adaptively by lazy binary splitting, with at least grain
+     * consecutive indices run together; raise grain when a single iteration
+     * is too cheap to be worth scheduling on its own.
+     *
+     * Called from one of system's workers, the calling worker runs pending
+     * tasks while it waits, so loops may be nested. If the body throws, the
+     * remaining iterations are abandoned and the first exception is rethrown
+     * once all running iterations have finished.
+     */
+    template <class System, class Index, class Body>
+    void parallel_for (System & system, Index first, Index last,
+                       Body && body, Index grain = Index (1))
+    {
+        static_assert (std::is_integral <Index>::value,
+                       "parallel_for requires an integral index type");
+
+        detail::for_context <typename std::remove_reference <Body>::type>
+            ctx (body);
+        detail::run_loop (system, ctx, first, last, grain);
+    }
+
+    /*
+     * parallel_reduce; folds the indices of [first, last) on the workers of
+     * system. Each subrange is folded with acc = map (std::move (acc), i),
+     * starting from identity, and the results of the subranges are then
+     * combined in index order with reduce (lhs, rhs), again starting from
+     * identity, which must therefore be an identity of reduce. reduce must be
+     * associative but need not be commutative.
+     *
+     * Splitting, nesting, and exception handling are as for parallel_for.
+     */
+    template <class System, class Index, class T, class Map, class Reduce>
+    T parallel_reduce (System & system, Index first, Index last,
+                       T const & identity, Map && map, Reduce && reduce,
+                       Index grain = Index (1))
+    {
+        static_assert (std::is_integral <Index>::value,
+                       "parallel_reduce requires an integral index type");
+
+        detail::reduce_context <
+            Index, T,
+            typename std::remove_reference <Map>::type,
+            typename std::remove_reference <Reduce>::type
+        > ctx (identity, map, reduce);
+        detail::run_loop (system, ctx, first, last, grain);
+        return ctx.result ();
+    }
+
+    /*
+     * task_group; a set of tasks run on system together and waited for as
+     * one, for fork/join parallelism with a shape not known up front:
+     *
+     *      dsa::task_group <> g {system};
+     *      g.run ([&] { left = walk (node->left); });
+     *      g.run ([&] { right = walk (node->right); });
+     *      g.wait ();
+     *
+     * run may be called from any thread, including from tasks of the group
+     * itself. Called from one of system's workers, wait runs pending tasks,
+     * the worker's own or stolen, until the group is done, so that groups may
+     * be nested to any depth without blocking workers. If a task throws, the
+     * group's tasks not yet started are skipped and the first exception is
+     * rethrown by wait once the others have finished.
+     *
+     * After wait returns (or throws) the group is empty and may be reused.
+     * The destructor waits for any tasks still running but discards their
+     * exceptions, so call wait first.
+     */
+    template <class System = task_system <>>
+    class task_group
+    {
+        using access = detail::task_system_access <System>;
+
+        System & system_;
+
+        /*
+         * pending counts the tasks not yet finished, plus one held by the
+         * group itself until wait; the state is then only done once wait has
+         * been called, and whichever of wait or the last task drops pending
+         * to zero is the one to flag it.
+         */
+        detail::loop_state state_;
+
+        void rearm (void)
+        {
+            this->state_.pending.store (1);
+            this->state_.failed.store (false);
+            this->state_.error = nullptr;
+            this->state_.done = false;
+            this->state_.waiting.store (false);
+        }
+
+    public:
+        explicit task_group (System & system)
+            : system_ (system)
+        {
+            this->rearm ();
+        }
+
+        task_group (task_group const &) = delete;
+        task_group & operator= (task_group const &) = delete;
+
+        ~task_group (void)
+        {
+            try {
+                this->wait ();
+            } catch (...) {
+            }
+        }
+
+        template <class F>
+        void run (F && f)
+        {
+            this->state_.add ();
+            try {
+                access::spawn_local (
+                    this->system_,
+                    detail::group_task <typename std::decay <F>::type> {
+                        &this->state_, std::forward <F> (f)
+                    }
+                );
+            } catch (...) {
+                this->state_.finish ();
+                throw;
+            }
+        }
+
+        void wait (void)
+        {
+            this->state_.finish ();
+            try {
+                this->state_.wait (this->system_);
+            } catch (...) {
+                this->rearm ();
+                throw;
+            }
+            this->rearm ();
+        }
+    };
+}   // namespace dsa
+
+#endif  // #ifndef DSA_PARALLEL_HPP
@@ -27,26 +27,477 @@
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <exception>
 #include <forward_list>
+#include <fstream>
+#include <functional>
+#include <iterator>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <ostream>
 #include <queue>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "utilities/functions.hpp"
 #include "utilities/sequence.hpp"
 
+/*
+ * Defined when the compiler supports C++20 coroutines, in which case
+ * task_system::schedule and the coroutine types of coroutine.hpp are
+ * available.
+ */
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define DSA_TASK_COROUTINES 1
+#endif
+#endif
+
+/*
+ * The size in bytes of a dsa::task object; callables (together with their
+ * bound arguments and result state) that fit in the remainder are stored in
+ * place rather than allocated.
+ */
+#ifndef DSA_TASK_SIZE
+#define DSA_TASK_SIZE 64
+#endif
+
+/*
+ * Define DSA_TASK_STATS to have every task_system keep per-worker counters
+ * and latency histograms, read with task_system::statistics. Without it none
+ * of this is compiled, and tasks and workers carry no timing overhead.
+ */
+
+/*
+ * Define DSA_TASK_TRACE to have every worker record when it runs tasks,
+ * steals, and parks, read with task_system::write_trace. Each worker keeps
+ * the last DSA_TASK_TRACE_EVENTS events, in a buffer allocated when the
+ * task_system is built.
+ */
+#ifndef DSA_TASK_TRACE_EVENTS
+#define DSA_TASK_TRACE_EVENTS 65536
+#endif
+
+/*
+ * The alignment used to keep data written by different threads on separate
+ * cache lines. std::hardware_destructive_interference_size is not used since
+ * its value may differ between translation units built for different CPUs;
+ * define this to 128 for targets that prefetch cache lines in pairs (recent
+ * x86) or have 128 byte lines (Apple silicon).
+ */
+#ifndef DSA_CACHE_LINE_SIZE
+#define DSA_CACHE_LINE_SIZE 64
+#endif
+
 
 namespace dsa
 {
+namespace detail
+{
+#if defined(DSA_TASK_STATS) || defined(DSA_TASK_TRACE)
+    inline std::uint64_t clock_ns (void) noexcept
+    {
+        return static_cast <std::uint64_t> (
+            std::chrono::duration_cast <std::chrono::nanoseconds> (
+                std::chrono::steady_clock::now ().time_since_epoch ()
+            ).count ()
+        );
+    }
+#endif
+
+    /*
+     * cache_aligned_allocator; an allocator returning storage aligned to
+     * DSA_CACHE_LINE_SIZE, since operator new only honours extended
+     * alignment from C++17 on. The original pointer is kept just below the
+     * aligned block.
+     */
+    template <class T>
+    class cache_aligned_allocator
+    {
+        static constexpr std::size_t line = DSA_CACHE_LINE_SIZE;
+
+    public:
+        using value_type = T;
+
+        cache_aligned_allocator (void) noexcept = default;
+
+        template <class U>
+        cache_aligned_allocator (cache_aligned_allocator <U> const &) noexcept
+        {}
+
+        T * allocate (std::size_t n)
+        {
+            auto const raw = ::operator new (n * sizeof (T) + line);
+            auto const base = reinterpret_cast <std::uintptr_t> (raw);
+            auto const aligned = static_cast <void *> (
+                static_cast <unsigned char *> (raw) +
+                (line - base % line)
+            );
+            static_cast <void **> (aligned) [-1] = raw;
+            return static_cast <T *> (aligned);
+        }
+
+        void deallocate (T * p, std::size_t) noexcept
+        {
+            ::operator delete (static_cast <void **> (
+                static_cast <void *> (p)
+            ) [-1]);
+        }
+
+        template <class U>
+        bool operator== (cache_aligned_allocator <U> const &) const noexcept
+        {
+            return true;
+        }
+
+        template <class U>
+        bool operator!= (cache_aligned_allocator <U> const &) const noexcept
+        {
+            return false;
+        }
+    };
+
+    template <class T>
+    using cache_aligned_vector = std::vector <T, cache_aligned_allocator <T>>;
+
+    /*
+     * cache_aligned; T on cache lines of its own, for elements of a
+     * cache_aligned_vector written by different threads.
+     */
+    template <class T>
+    struct alignas (DSA_CACHE_LINE_SIZE) cache_aligned : T
+    {
+        using T::T;
+    };
+
+    template <class F, class ... Args>
+    using task_result_t = decltype (utility::invoke (
+        std::declval <typename std::decay <F>::type> (),
+        std::declval <typename std::decay <Args>::type> ()...
+    ));
+
+    /*
+     * pool_arena; the per-thread state behind pool_allocator. Blocks are
+     * carved out of large slabs into power-of-two size classes and kept on
+     * per-class free lists. The owning thread allocates and frees without
+     * synchronization; a block freed by any other thread is pushed onto the
+     * owner's lock-free remote list for that class, which the owner reclaims
+     * wholesale once its local list runs dry.
+     *
+     * Arenas are never returned to the system. When a thread exits its arena
+     * is parked on a global list and handed to the next thread that needs
+     * one, so blocks still in flight remain valid and memory use is bounded by
+     * the peak number of concurrently allocating threads.
+     */
+    class pool_arena
+    {
+    public:
+        static constexpr std::size_t min_block = 32;
+        static constexpr std::size_t num_classes = 6;
+        static constexpr std::size_t max_block = min_block << (num_classes - 1);
+        static constexpr std::size_t slab_size = 64 * 1024;
+
+        /*
+         * Every block is preceded by a header naming its owning arena, which
+         * is all a foreign thread needs in order to give the block back.
+         */
+        union alignas (std::max_align_t) header
+        {
+            pool_arena * owner;
+            header * next;
+        };
+
+        static std::size_t class_of (std::size_t bytes) noexcept
+        {
+            std::size_t c = 0;
+            while ((min_block << c) < bytes)
+                ++c;
+            return c;
+        }
+
+        static pool_arena & local (void)
+        {
+            thread_local holder h;
+            auto & a = current ();
+            if (!a)
+                a = adopt ();
+            return *a;
+        }
+
+        void * allocate (std::size_t c)
+        {
+            auto & list = this->free_ [c];
+            if (!list)
+                list = this->remote_ [c].exchange (
+                    nullptr, std::memory_order_acquire
+                );
+            if (!list)
+                this->refill (c);
+
+            auto h = list;
+            list = h->next;
+            h->owner = this;
+            return h + 1;
+        }
+
+        static void deallocate (void * p, std::size_t c) noexcept
+        {
+            auto h = static_cast <header *> (p) - 1;
+            auto const owner = h->owner;
+            if (owner == current ()) {
+                h->next = owner->free_ [c];
+                owner->free_ [c] = h;
+            } else {
+                auto & list = owner->remote_ [c];
+                h->next = list.load (std::memory_order_relaxed);
+                while (!list.compare_exchange_weak (
+                        h->next, h,
+                        std::memory_order_release, std::memory_order_relaxed))
+                    ;
+            }
+        }
+
+    private:
+        struct registry
+        {
+            std::mutex mutex;
+            std::vector <pool_arena *> idle;
+        };
+
+        /*
+         * Parks the thread's arena on exit; deallocations from thread-local
+         * destructors that run later take the remote path instead.
+         */
+        struct holder
+        {
+            ~holder (void)
+            {
+                auto & a = current ();
+                if (a) {
+                    auto & r = get_registry ();
+                    std::unique_lock <std::mutex> lock (r.mutex);
+                    r.idle.push_back (a);
+                    a = nullptr;
+                }
+            }
+        };
+
+        static pool_arena *& current (void) noexcept
+        {
+            thread_local pool_arena * a {nullptr};
+            return a;
+        }
+
+        static pool_arena * adopt (void)
+        {
+            auto & r = get_registry ();
+            {
+                std::unique_lock <std::mutex> lock (r.mutex);
+                if (!r.idle.empty ()) {
+                    auto const a = r.idle.back ();
+                    r.idle.pop_back ();
+                    return a;
+                }
+            }
+            return new pool_arena;
+        }
+
+        /*
+         * Deliberately leaked, so that threads exiting during static
+         * destruction can still park their arenas.
+         */
+        static registry & get_registry (void)
+        {
+            static auto r = new registry;
+            return *r;
+        }
+
+        void refill (std::size_t c)
+        {
+            auto const block = sizeof (header) + (min_block << c);
+            auto const count = slab_size / block;
+            auto const slab = static_cast <unsigned char *> (
+                ::operator new (slab_size)
+            );
+
+            header * list = nullptr;
+            for (std::size_t k = count; k-- > 0;) {
+                auto h = reinterpret_cast <header *> (slab + k * block);
+                h->next = list;
+                list = h;
+            }
+            this->free_ [c] = list;
+        }
+
+        pool_arena (void) = default;
+
+        header * free_ [num_classes] {};
+        std::atomic <header *> remote_ [num_classes] {};
+    };
+
+    struct task_access;
+}   // namespace detail
+
+    /*
+     * pool_allocator; a stateless allocator drawing from per-thread
+     * size-class pools (see detail::pool_arena). Requests larger than the
+     * largest size class or over-aligned types fall through to the global
+     * operator new. This is the default allocator of task_system, so that
+     * once the pools are warm pushing a task does not call malloc.
+     */
+    template <class T>
+    class pool_allocator
+    {
+        using arena = detail::pool_arena;
+
+        static constexpr bool pooled (std::size_t n) noexcept
+        {
+            return alignof (T) <= alignof (std::max_align_t) &&
+                   n * sizeof (T) <= arena::max_block;
+        }
+
+    public:
+        using value_type = T;
+
+        pool_allocator (void) noexcept = default;
+
+        template <class U>
+        pool_allocator (pool_allocator <U> const &) noexcept
+        {}
+
+        T * allocate (std::size_t n)
+        {
+            if (pooled (n))
+                return static_cast <T *> (
+                    arena::local ().allocate (arena::class_of (n * sizeof (T)))
+                );
+            return static_cast <T *> (::operator new (n * sizeof (T)));
+        }
+
+        void deallocate (T * p, std::size_t n) noexcept
+        {
+            if (pooled (n))
+                arena::deallocate (p, arena::class_of (n * sizeof (T)));
+            else
+                ::operator delete (p);
+        }
+
+        template <class U>
+        bool operator== (pool_allocator <U> const &) const noexcept
+        {
+            return true;
+        }
+
+        template <class U>
+        bool operator!= (pool_allocator <U> const &) const noexcept
+        {
+            return false;
+        }
+    };
+
+    /*
+     * labeled; a callable together with a name for it. Submitting one to a
+     * task_system behaves exactly as submitting the callable itself, except
+     * that with DSA_TASK_TRACE the task appears under that name in the trace.
+     * The name is not copied, and must outlive the task_system's trace; a
+     * string literal is the intended use. See label.
+     */
+    template <class F>
+    struct labeled
+    {
+        char const * name;
+        F fn;
+
+        template <class ... Args>
+        auto operator() (Args && ... args)
+            -> decltype (utility::invoke (fn, std::forward <Args> (args)...))
+        {
+            return utility::invoke (this->fn, std::forward <Args> (args)...);
+        }
+
+        template <class ... Args>
+        auto operator() (Args && ... args) const
+            -> decltype (utility::invoke (fn, std::forward <Args> (args)...))
+        {
+            return utility::invoke (this->fn, std::forward <Args> (args)...);
+        }
+    };
+
+    template <class F>
+    labeled <typename std::decay <F>::type> label (char const * name, F && f)
+    {
+        return labeled <typename std::decay <F>::type> {
+            name, std::forward <F> (f)
+        };
+    }
+
+namespace detail
+{
+    /*
+     * The name of a callable for the trace, if it carries one. This is a
+     * class template so that wrappers declared further down, such as
+     * cancellable, can specialize it; an overload of label_of declared after
+     * task would not be seen from task's constructor.
+     */
+    template <class F>
+    struct label_traits
+    {
+        static char const * of (F const &) noexcept
+        {
+            return nullptr;
+        }
+    };
+
+    template <class F>
+    struct label_traits <labeled <F>>
+    {
+        static char const * of (labeled <F> const & f) noexcept
+        {
+            return f.name;
+        }
+    };
+
+    template <class F>
+    char const * label_of (F const & f) noexcept
+    {
+        return label_traits <F>::of (f);
+    }
+
+    /*
+     * Whether a callable's cancellation has been requested before it ran;
+     * only cancellable, specialized further down, ever has one.
+     */
+    template <class F>
+    struct cancel_traits
+    {
+        static bool requested (F const &) noexcept
+        {
+            return false;
+        }
+    };
+}   // namespace detail
+
     /*
-     * task; a type-erased, allocator-aware std::packaged_task that also
-     * contains its own arguments. The underlying packaged_task and the stored
-     * argument tuple can be heap allocated or allocated with a provided
-     * allocator.
+     * task; a type-erased, allocator-aware packaged callable that also
+     * contains its own arguments, much like a std::packaged_task bound to its
+     * arguments. Arguments are decay-copied into the task, as with std::thread
+     * and std::async.
+     *
+     * A task object occupies DSA_TASK_SIZE bytes (one cache line by default).
+     * Models that fit in the remaining inline buffer and are nothrow movable
+     * are stored in place, so that moving a task is a small copy with no
+     * allocation; larger models, and the shared state of the returned future,
+     * are heap allocated or allocated with a provided allocator.
      *
      * There is a single helper method for creating task objects: make_task,
      * which returns a pair of the newly constructed task and a std::future
@@ -55,63 +506,106 @@ namespace dsa
     class task
     {
     public:
-        task (void) = default;
-        ~task (void) = default;
+        static constexpr std::size_t inline_size = DSA_TASK_SIZE
+            - sizeof (void *)
+#ifdef DSA_TASK_STATS
+            - sizeof (std::uint64_t)
+#endif
+#ifdef DSA_TASK_TRACE
+            - sizeof (char const *)
+#endif
+            ;
+
+        task (void) noexcept
+            : _t {nullptr}
+        {}
+
+        ~task (void)
+        {
+            this->reset ();
+        }
 
         task (task const &) = delete;
-        task (task &&) noexcept = default;
+
+        task (task && other) noexcept
+            : _t {nullptr}
+        {
+            this->take (other);
+        }
 
         task & operator= (task const &) = delete;
-        task & operator= (task &&) noexcept = default;
+
+        task & operator= (task && other) noexcept
+        {
+            if (this != &other) {
+                this->reset ();
+                this->take (other);
+            }
+            return *this;
+        }
 
         void swap (task & other) noexcept
         {
-            std::swap (this->_t, other._t);
+            task tmp (std::move (other));
+            other = std::move (*this);
+            *this = std::move (tmp);
         }
 
         operator bool (void) const noexcept
         {
-            return static_cast <bool> (this->_t);
+            return this->_t != nullptr;
         }
 
-        template <class>
+        template <class, class>
         friend class task_system;
 
+        friend struct detail::task_access;
+
         template <class F, class ... Args>
         friend std::pair <
-            task,  std::future <typename std::result_of <F (Args...)>::type>
+            task,  std::future <detail::task_result_t <F, Args...>>
         > make_task (F && f, Args && ... args)
         {
             using pair_type = std::pair <
-                task, std::future <typename std::result_of <F (Args...)>::type>
+                task, std::future <detail::task_result_t <F, Args...>>
             >;
             using model_type = task_model <
-                typename std::result_of <F (Args...)>::type (Args...)
+                typename std::decay <F>::type,
+                std::allocator <task_concept>,
+                detail::task_result_t <F, Args...>,
+                typename std::decay <Args>::type...
             >;
 
-            task t (std::forward <F> (f), std::forward <Args> (args)...);
-            auto fut = dynamic_cast <model_type &> (*t._t).get_future ();
+            task t;
+            t.label (f);
+            auto fut = t.emplace <model_type> (
+                std::allocator <task_concept> (),
+                std::forward <F> (f), std::forward <Args> (args)...
+            ).get_future ();
             return pair_type (std::move (t), std::move (fut));
         }
 
         template <class Allocator, class F, class ... Args>
         friend std::pair <
-            task, std::future <typename std::result_of <F (Args...)>::type>
+            task, std::future <detail::task_result_t <F, Args...>>
         > make_task (std::allocator_arg_t, Allocator const & alloc,
                      F && f, Args && ... args)
         {
             using pair_type = std::pair <
-                task, std::future <typename std::result_of <F (Args...)>::type>
+                task, std::future <detail::task_result_t <F, Args...>>
             >;
             using model_type = task_model <
-                typename std::result_of <F (Args...)>::type (Args...)
+                typename std::decay <F>::type,
+                Allocator,
+                detail::task_result_t <F, Args...>,
+                typename std::decay <Args>::type...
             >;
 
-            task t (
-                std::allocator_arg_t (), alloc,
-                std::forward <F> (f), std::forward <Args> (args)...
-            );
-            auto fut = dynamic_cast <model_type &> (*t._t).get_future ();
+            task t;
+            t.label (f);
+            auto fut = t.emplace <model_type> (
+                alloc, std::forward <F> (f), std::forward <Args> (args)...
+            ).get_future ();
             return pair_type (std::move (t), std::move (fut));
         }
 
@@ -124,354 +618,3299 @@ namespace dsa
         }
 
     private:
-        template <class F, class ... Args>
-        task (F && f, Args && ... args)
-            : _t (
-                new task_model <
-                    typename std::result_of <F (Args...)>::type (Args...)
-                > (std::forward <F> (f), std::forward <Args> (args)...)
-            )
-        {}
+        /*
+         * Whether the task was pushed with a cancellation that has since been
+         * requested; running it then only reports that it was dropped.
+         */
+        bool cancelled (void) const noexcept
+        {
+            return this->_t && this->_t->cancelled_ ();
+        }
+
+        struct detached_t {};
 
         template <class Allocator, class F, class ... Args>
-        task (std::allocator_arg_t,
+        task (detached_t,
+              std::allocator_arg_t,
               Allocator const & alloc,
               F && f, Args && ... args)
-            : _t (
-                new task_model <
-                    typename std::result_of <F (Args...)>::type (Args...)
-                > (std::allocator_arg_t (), alloc,
-                   std::forward <F> (f), std::forward <Args> (args)...)
-            )
-        {}
+            : _t {nullptr}
+        {
+            this->label (f);
+            this->emplace <detached_model <
+                typename std::decay <F>::type,
+                Allocator,
+                typename std::decay <Args>::type...
+            >> (alloc, std::forward <F> (f), std::forward <Args> (args)...);
+        }
 
         struct task_concept
         {
             virtual ~task_concept (void) noexcept {}
             virtual void invoke_ (void) = 0;
+            virtual bool cancelled_ (void) const noexcept = 0;
+
+            /*
+             * Heap models only; destroys the model and releases its storage
+             * through the same allocator it was obtained from.
+             */
+            virtual void destroy_ (void) noexcept = 0;
+
+            /*
+             * Inline models only; move constructs the model into the given
+             * inline buffer, destroys this one, and returns the new model.
+             */
+            virtual task_concept * move_to_ (void * buf) noexcept = 0;
         };
 
-        template <class> struct task_model;
+        template <class R>
+        struct invoker
+        {
+            template <class F, class ... Args>
+            static void apply (std::promise <R> & p, F && f, Args && ... args)
+            {
+                p.set_value (utility::invoke (
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ));
+            }
+        };
 
         /*
-         * tasks are assumed to be immediately invokable; that is,
-         * invoking the underlying pakcaged_task with the provided arguments
-         * will not block.
+         * The storage management shared by all models. The (typically empty)
+         * allocator is a base so that it takes no space.
          */
-        template <class R, class ... Args>
-        struct task_model <R (Args...)> : task_concept
+        template <class Model, class Allocator>
+        struct model_base
+            : task_concept
+            , private std::allocator_traits <Allocator>::template
+                rebind_alloc <Model>
         {
-            template <class F>
-            explicit task_model (F && f, Args && ... args)
-                : _f    (std::forward <F> (f))
-                , _args (std::forward <Args> (args)...)
-            {}
+            using allocator_type = typename std::allocator_traits <
+                Allocator
+            >::template rebind_alloc <Model>;
 
-            template <class Allocator, class F>
-            explicit task_model (
-                std::allocator_arg_t, Allocator const & alloc,
-                F && f, Args && ... args
-            )
-                : _f    (std::allocator_arg_t (), alloc, std::forward <F> (f))
-                , _args (std::allocator_arg_t (), alloc,
-                         std::forward <Args> (args)...)
+            explicit model_base (allocator_type const & alloc)
+                : allocator_type (alloc)
             {}
 
-            std::future <R> get_future (void)
+            void destroy_ (void) noexcept override
             {
-                return this->_f.get_future ();
+                auto const self = static_cast <Model *> (this);
+                allocator_type alloc (*this);
+                std::allocator_traits <allocator_type>::destroy (alloc, self);
+                std::allocator_traits <allocator_type>::deallocate (
+                    alloc, self, 1
+                );
             }
 
-            void invoke_ (void) override
+            task_concept * move_to_ (void * buf) noexcept override
             {
-                utility::apply (this->_f, this->_args);
+                return this->relocate (fits_inline <Model> {}, buf);
             }
 
         private:
-            std::packaged_task <R (Args...)> _f;
-            std::tuple <Args...> _args;
-        };
+            task_concept * relocate (std::true_type, void * buf) noexcept
+            {
+                auto const self = static_cast <Model *> (this);
+                auto const t = ::new (buf) Model (std::move (*self));
+                self->~Model ();
+                return t;
+            }
 
-        std::unique_ptr <task_concept> _t;
-    };
+            /*
+             * Models too large to be stored inline are never relocated.
+             */
+            task_concept * relocate (std::false_type, void *) noexcept
+            {
+                std::terminate ();
+            }
+        };
 
-    /*
-     * task_system; a work-stealing tasking system partly inspired by Sean
-     * Parent's "Better Code: Concurrency" talk; see http://sean-parent.stlab.cc
-     */
-    template <class Allocator = std::allocator <task>>
-    class task_system
-    {
-        class task_queue
+        /*
+         * tasks are assumed to be immediately invokable; that is,
+         * invoking the underlying callable with the provided arguments
+         * will not block.
+         *
+         * The callable shares a tuple with its arguments so that it takes no
+         * space when empty.
+         */
+        template <class F, class Allocator, class R, class ... Args>
+        struct task_model
+            : model_base <task_model <F, Allocator, R, Args...>, Allocator>
         {
-            std::queue <task> tasks_;
-            std::condition_variable cv_;
-            std::mutex mutex_;
-            std::atomic_bool done_ {false};
+            using base_type = model_base <task_model, Allocator>;
+            using typename base_type::allocator_type;
 
-        public:
-            task_queue (void)
-                : tasks_ {}
+            template <class G, class ... Brgs>
+            explicit task_model (allocator_type const & alloc,
+                                 G && g, Brgs && ... args)
+                : base_type (alloc)
+                , _fargs (std::forward <G> (g), std::forward <Brgs> (args)...)
+                , _p     (std::allocator_arg_t (), alloc)
             {}
 
-            task_queue (task_queue const &) = delete;
-
-            task_queue (task_queue && other) noexcept
-                : tasks_ (std::move (other).tasks_)
-                , done_  (other.done_.load ())
-            {}
+            task_model (task_model &&) = default;
 
-            void set_done (void)
+            std::future <R> get_future (void)
             {
-                this->done_.store (true);
-                this->cv_.notify_all ();
+                return this->_p.get_future ();
             }
 
-            std::pair <bool, task> try_pop (void)
+            void invoke_ (void) override
             {
-                std::unique_lock <std::mutex>
-                    lock (this->mutex_, std::try_to_lock);
-                if (!lock || this->tasks_.empty ()) {
-                    return std::make_pair (false, task {});
-                } else {
-                    auto t = std::move (this->tasks_.front ());
-                    this->tasks_.pop ();
-                    return std::make_pair (true, std::move (t));
-                }
+                this->call (utility::make_index_sequence <sizeof... (Args)> {});
             }
 
-            bool try_push (task & t)
+            bool cancelled_ (void) const noexcept override
             {
-                {
-                    std::unique_lock <std::mutex>
-                        lock (this->mutex_, std::try_to_lock);
-                    if (!lock)
-                        return false;
+                return detail::cancel_traits <F>::requested (
+                    std::get <0> (this->_fargs)
+                );
+            }
 
-                    this->tasks_.emplace (std::move (t));
+        private:
+            template <std::size_t ... I>
+            void call (utility::index_sequence <I...>)
+            {
+                try {
+                    invoker <R>::apply (
+                        this->_p,
+                        std::get <0> (std::move (this->_fargs)),
+                        std::get <I + 1> (std::move (this->_fargs))...
+                    );
+                } catch (...) {
+                    this->_p.set_exception (std::current_exception ());
                 }
-
-                this->cv_.notify_one ();
-                return true;
             }
 
-            std::pair <bool, task> pop (void)
-            {
-                std::unique_lock <std::mutex> lock (this->mutex_);
-                while (this->tasks_.empty () && !this->done_)
-                    this->cv_.wait (lock);
+            std::tuple <F, Args...> _fargs;
+            std::promise <R> _p;
+        };
 
-                if (this->tasks_.empty ())
-                    return std::make_pair (false, task {});
+        /*
+         * A fire-and-forget model; there is no shared state to report the
+         * result through, so the result is discarded and any exception
+         * propagates out of task::operator () to the caller (for task_system,
+         * its exception handler).
+         */
+        template <class F, class Allocator, class ... Args>
+        struct detached_model
+            : model_base <detached_model <F, Allocator, Args...>, Allocator>
+        {
+            using base_type = model_base <detached_model, Allocator>;
+            using typename base_type::allocator_type;
 
-                auto t = std::move (this->tasks_.front ());
-                this->tasks_.pop ();
-                return std::make_pair (true, std::move (t));
-            }
+            template <class G, class ... Brgs>
+            explicit detached_model (allocator_type const & alloc,
+                                     G && g, Brgs && ... args)
+                : base_type (alloc)
+                , _fargs (std::forward <G> (g), std::forward <Brgs> (args)...)
+            {}
+
+            detached_model (detached_model &&) = default;
 
-            void push (task t)
+            void invoke_ (void) override
             {
-                {
-                    std::unique_lock <std::mutex> lock (this->mutex_);
-                    this->tasks_.emplace (std::move (t));
-                }
-                this->cv_.notify_one ();
+                this->call (utility::make_index_sequence <sizeof... (Args)> {});
+            }
+
+            bool cancelled_ (void) const noexcept override
+            {
+                return detail::cancel_traits <F>::requested (
+                    std::get <0> (this->_fargs)
+                );
+            }
+
+        private:
+            template <std::size_t ... I>
+            void call (utility::index_sequence <I...>)
+            {
+                utility::invoke (
+                    std::get <0> (std::move (this->_fargs)),
+                    std::get <I + 1> (std::move (this->_fargs))...
+                );
             }
+
+            std::tuple <F, Args...> _fargs;
         };
 
-        std::vector <task_queue> queues_;
-        std::vector <std::thread> threads_;
-        std::vector <bool> exited_;
-        typename Allocator::template rebind <task::task_concept>::other
-            alloc_;
-        std::size_t nthreads_;
-        std::size_t current_index_ {0};
-        std::atomic_size_t queued_ {0};
+        template <class Model>
+        using fits_inline = std::integral_constant <bool,
+            sizeof (Model) <= inline_size &&
+            alignof (Model) <= alignof (std::max_align_t) &&
+            std::is_nothrow_move_constructible <Model>::value
+        >;
 
-        void run (std::size_t id)
+        /*
+         * Constructs a model of the given type in place of any current one
+         * and returns it as its concrete type, so that callers can reach
+         * model specific members (such as the future of a task_model)
+         * before the type is erased, without resorting to RTTI.
+         */
+        template <class Model, class Allocator, class ... Args>
+        Model & emplace (Allocator const & a, Args && ... args)
         {
-            while (true) {
-                std::pair <bool, task> p;
+            this->reset ();
+            return this->emplace_ <Model> (
+                fits_inline <Model> {}, a, std::forward <Args> (args)...
+            );
+        }
 
-                for (std::size_t k = 0; k < 10 * this->nthreads_; ++k) {
-                    p = this->queues_ [(id + k) % this->nthreads_].try_pop ();
-                    if (p.first) {
-                        this->queued_--;
-                        goto call;
-                    }
-                }
+        template <class Model, class Allocator, class ... Args>
+        Model & emplace_ (std::true_type,
+                          Allocator const & a, Args && ... args)
+        {
+            typename Model::allocator_type alloc (a);
+            auto const p = ::new (static_cast <void *> (this->_buf))
+                Model (alloc, std::forward <Args> (args)...);
+            this->_t = p;
+            return *p;
+        }
 
-                p = this->queues_ [id].pop ();
-                if (p.first) {
-                    this->queued_--;
-                    goto call;
-                } else {
-                    goto finish;
-                }
+        template <class Model, class Allocator, class ... Args>
+        Model & emplace_ (std::false_type,
+                          Allocator const & a, Args && ... args)
+        {
+            using traits = std::allocator_traits <
+                typename Model::allocator_type
+            >;
 
-            call:
-                p.second ();
-                continue;
+            typename Model::allocator_type alloc (a);
+            auto const p = traits::allocate (alloc, 1);
+            try {
+                traits::construct (
+                    alloc, p, alloc, std::forward <Args> (args)...
+                );
+            } catch (...) {
+                traits::deallocate (alloc, p, 1);
+                throw;
             }
+            this->_t = p;
+            return *p;
+        }
 
-        finish:
-            /*
-             * The done signal has been set and our queue is empty, but there
-             * may still be queued tasks that must be completed, so try and
-             * steal work from other queues before exiting.
-             */
-            while (this->queued_) {
-                std::pair <bool, task> p;
-
-                for (std::size_t k = 0; k < this->nthreads_; ++k) {
-                    p = this->queues_ [(id + k) % this->nthreads_].try_pop ();
-                    if (p.first) {
-                        this->queued_--;
-                        p.second ();
-                    }
-                }
+        bool is_inline (void) const noexcept
+        {
+            return static_cast <void const *> (this->_t) ==
+                static_cast <void const *> (this->_buf);
+        }
 
-                std::this_thread::yield ();
+        void reset (void) noexcept
+        {
+            if (this->_t) {
+                if (this->is_inline ())
+                    this->_t->~task_concept ();
+                else
+                    this->_t->destroy_ ();
+                this->_t = nullptr;
             }
+        }
 
-            this->exited_ [id] = true;
+        void take (task & other) noexcept
+        {
+            if (other.is_inline ())
+                this->_t = other._t->move_to_ (this->_buf);
+            else
+                this->_t = other._t;
+            other._t = nullptr;
+#ifdef DSA_TASK_STATS
+            this->_pushed = other._pushed;
+#endif
+#ifdef DSA_TASK_TRACE
+            this->_label = other._label;
+#endif
         }
 
-        void join (void)
+        /*
+         * Picks up the name given with dsa::label, if f has one.
+         */
+        template <class F>
+        void label (F const & f) noexcept
         {
-            this->done ();
-            for (auto & th : this->threads_)
-                th.join ();
+#ifdef DSA_TASK_TRACE
+            this->_label = detail::label_of (f);
+#else
+            (void) f;
+#endif
         }
 
-    public:
-        task_system (void)
-            : task_system (std::thread::hardware_concurrency ())
-        {}
+        alignas (std::max_align_t) unsigned char _buf [inline_size];
+        task_concept * _t;
 
-        task_system (std::size_t nthreads,
-                           Allocator const & alloc = Allocator ())
-            : queues_   {}
-            , threads_  {}
-            , exited_   (nthreads, false)
-            , alloc_    (alloc)
-            , nthreads_ {nthreads}
-        {
-            this->queues_.reserve (nthreads);
-            for (std::size_t th = 0; th < nthreads; ++th)
-                this->queues_.emplace_back ();
+#ifdef DSA_TASK_STATS
+        /*
+         * When the task was pushed to a task_system, in detail::clock_ns
+         * nanoseconds.
+         */
+        std::uint64_t _pushed {0};
+#endif
 
-            this->threads_.reserve (nthreads);
-            for (std::size_t th = 0; th < nthreads; ++th)
-                this->threads_.emplace_back (
-                    &task_system::run, this, th
-                );
+#ifdef DSA_TASK_TRACE
+        char const * _label {nullptr};
+#endif
+    };
+
+    template <>
+    struct task::invoker <void>
+    {
+        template <class F, class ... Args>
+        static void apply (std::promise <void> & p, F && f, Args && ... args)
+        {
+            utility::invoke (
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+            p.set_value ();
         }
+    };
 
-        ~task_system (void)
+    /*
+     * make_task is defined as a friend of task; these declarations make it
+     * visible to ordinary (non-ADL) lookup.
+     */
+    template <class F, class ... Args>
+    std::pair <task, std::future <detail::task_result_t <F, Args...>>>
+        make_task (F && f, Args && ... args);
+
+    template <class Allocator, class F, class ... Args>
+    std::pair <task, std::future <detail::task_result_t <F, Args...>>>
+        make_task (std::allocator_arg_t, Allocator const & alloc,
+                   F && f, Args && ... args);
+
+    /*
+     * chase_lev_deque; a fixed capacity, single-owner work-stealing deque
+     * after Chase and Lev's "Dynamic Circular Work-Stealing Deque" (SPAA '05).
+     * The owning thread pushes and pops at the bottom without locking, in LIFO
+     * order, while any other thread may steal from the top with a single CAS.
+     *
+     * Elements are stored by value, so unlike the original algorithm a thief
+     * cannot speculatively read a slot before winning the CAS on top. Instead,
+     * each slot carries a sequence stamp recording the next index it may be
+     * written for; a consumer publishes the stamp only after moving the element
+     * out, and the owner refuses to overwrite a slot whose stamp does not
+     * match. A full deque (or a slot still being drained by a slow thief) makes
+     * try_push fail rather than grow; it is the caller's responsibility to
+     * keep the element elsewhere.
+     */
+    template <class T>
+    class chase_lev_deque
+    {
+        using index_type = std::int64_t;
+
+        struct slot
         {
-            this->join ();
+            std::atomic <index_type> seq;
+            T value;
+        };
+
+        std::unique_ptr <slot []> slots_;
+        index_type capacity_;
+        index_type mask_;
+        /*
+         * Thieves CAS top_ while the owner writes bottom_ on every push and
+         * pop, so each has a cache line of its own.
+         */
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic <index_type> top_ {0};
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic <index_type> bottom_ {0};
+
+        slot & at (index_type i) noexcept
+        {
+            return this->slots_ [static_cast <std::size_t> (i & this->mask_)];
         }
 
-        void done (void)
+    public:
+        explicit chase_lev_deque (std::size_t capacity = 1024)
+            : slots_    {}
+            , capacity_ {2}
+            , mask_     {1}
         {
-            for (auto & q : this->queues_)
-                q.set_done ();
+            while (this->capacity_ < static_cast <index_type> (capacity))
+                this->capacity_ *= 2;
+            this->mask_ = this->capacity_ - 1;
+
+            this->slots_.reset (
+                new slot [static_cast <std::size_t> (this->capacity_)]
+            );
+            for (index_type i = 0; i < this->capacity_; ++i)
+                this->at (i).seq.store (i, std::memory_order_relaxed);
         }
 
-        void wait_to_completion (void)
+        chase_lev_deque (chase_lev_deque const &) = delete;
+        chase_lev_deque & operator= (chase_lev_deque const &) = delete;
+
+        std::size_t capacity (void) const noexcept
         {
-            while (true) {
-                std::this_thread::yield ();
+            return static_cast <std::size_t> (this->capacity_);
+        }
 
-                if (this->queued_) {
-                    continue;
-                } else {
-                    auto should_exit = true;
-                    for (auto b : this->exited_)
-                        should_exit &= b;
-                    if (should_exit)
-                        return;
-                }
-            }
+        /*
+         * An approximation only; the value may be stale by the time it is
+         * read when other threads are stealing.
+         */
+        bool empty (void) const noexcept
+        {
+            return this->bottom_.load (std::memory_order_relaxed) <=
+                this->top_.load (std::memory_order_relaxed);
         }
 
-        void reset (void)
+        /*
+         * As approximate as empty.
+         */
+        std::size_t size (void) const noexcept
         {
-            this->join ();
-            this->threads_.clear ();
-            this->queues_.clear ();
-            this->queued_.store (0);
+            auto const b = this->bottom_.load (std::memory_order_relaxed);
+            auto const t = this->top_.load (std::memory_order_relaxed);
+            return b > t ? static_cast <std::size_t> (b - t) : 0;
+        }
 
-            for (std::size_t th = 0; th < this->nthreads_; ++th)
-                this->queues_.emplace_back ();
+        /*
+         * Owner only. On success the element is moved from; on failure it is
+         * left untouched.
+         */
+        bool try_push (T & value)
+        {
+            auto const b = this->bottom_.load (std::memory_order_relaxed);
+            auto & s = this->at (b);
+            if (s.seq.load (std::memory_order_acquire) != b)
+                return false;
 
-            for (std::size_t th = 0; th < this->nthreads_; ++th)
-                this->threads_.emplace_back (
-                    &task_system::run, this, th
-                );
+            s.value = std::move (value);
+            s.seq.store (b + 1, std::memory_order_relaxed);
+            this->bottom_.store (b + 1, std::memory_order_release);
+            return true;
         }
 
-        template <class F, class ... Args>
-        auto push (F && f, Args && ... args)
-            -> typename std::remove_reference <
-                decltype (make_task (
-                    std::allocator_arg_t {}, this->alloc_,
-                    std::forward <F> (f), std::forward <Args> (args)...
-                ).second)
-            >::type
+        /*
+         * Owner only.
+         */
+        bool try_pop (T & out)
         {
-            auto t = make_task (
-                std::allocator_arg_t {}, this->alloc_,
-                std::forward <F> (f), std::forward <Args> (args)...
-            );
+            auto const b = this->bottom_.load (std::memory_order_relaxed) - 1;
+            this->bottom_.store (b, std::memory_order_release);
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            auto t = this->top_.load (std::memory_order_relaxed);
 
-            auto const idx = this->current_index_++;
-            for (std::size_t k = 0; k < 10 * this->nthreads_; ++k) {
+            if (t > b) {
+                this->bottom_.store (b + 1, std::memory_order_release);
+                return false;
+            }
+
+            auto & s = this->at (b);
+            if (t == b) {
                 /*
-                 * In order to maintain consistency we need to speculatively
-                 * incremement the queued count and then decrement only if
-                 * the try_push call failed. This is because the queued count
-                 * must be incremented before a push and decremented only after
-                 * a pop.
+                 * This is the last element, so we must race any thieves for
+                 * it; whoever wins the CAS on top owns the slot.
                  */
-                this->queued_++;
-                if (this->queues_ [(idx + k) % this->nthreads_]
-                        .try_push (t.first)) {
-                    return std::move (t.second);
-                } else {
-                    this->queued_--;
-                }
+                auto const won = this->top_.compare_exchange_strong (
+                    t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed
+                );
+                this->bottom_.store (b + 1, std::memory_order_release);
+                if (!won)
+                    return false;
+
+                out = std::move (s.value);
+                s.seq.store (b + this->capacity_, std::memory_order_release);
+                return true;
             }
 
-            this->queued_++;
-            this->queues_ [idx % this->nthreads_].push (std::move (t.first));
-            return std::move (t.second);
+            out = std::move (s.value);
+            s.seq.store (b, std::memory_order_release);
+            return true;
         }
 
-        void push (task && t)
+        /*
+         * Any thread.
+         */
+        bool try_steal (T & out)
         {
-            auto const idx = this->current_index_++;
-            for (std::size_t k = 0; k < 10 * this->nthreads_; ++k) {
-                /*
-                 * In order to maintain consistency we need to speculatively
-                 * incremement the queued count and then decrement only if
-                 * the try_push call failed. This is because the queued count
-                 * must be incremented before a push and decremented only after
-                 * a pop.
-                 */
-                this->queued_++;
-                if (this->queues_ [(idx + k) % this->nthreads_].try_push (t)) {
-                    return;
-                } else {
-                    this->queued_--;
+            auto t = this->top_.load (std::memory_order_acquire);
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            auto const b = this->bottom_.load (std::memory_order_acquire);
+
+            if (t >= b)
+                return false;
+
+            if (!this->top_.compare_exchange_strong (
+                    t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed))
+                return false;
+
+            auto & s = this->at (t);
+            out = std::move (s.value);
+            s.seq.store (t + this->capacity_, std::memory_order_release);
+            return true;
+        }
+    };
+
+    /*
+     * task_queue; a mutex protected FIFO of tasks. This is the original queue
+     * backend of task_system and remains available as a queue policy, e.g.
+     * task_system <pool_allocator <task>, task_queue>.
+     *
+     * A task_system queue policy must provide the following, where the owner
+     * is the worker thread with the same index as the queue:
+     *
+     *      bool try_push (task &);                     any thread; non-blocking
+     *      void push (task);                           any thread
+     *      void push_bulk (task *, task *);            any thread; moves from
+     *                                                  the given range
+     *      void push_local (task);                     owner
+     *      bool empty ();                              owner; approximate
+     *      std::pair <bool, task> try_pop ();          owner; non-blocking
+     *      std::pair <bool, task> try_steal ();        any thread; non-blocking
+     *      std::pair <bool, task> try_steal_half (Queue & thief,
+     *                                             std::size_t & moved);
+     *                                                  thief's owner;
+     *                                                  non-blocking; as
+     *                                                  try_steal, but also
+     *                                                  moves up to half of
+     *                                                  the remaining tasks
+     *                                                  onto thief, setting
+     *                                                  moved to their number
+     *
+     * Queues never block their consumers; idle workers park on the
+     * task_system's eventcount instead (see detail::eventcount).
+     */
+    class task_queue
+    {
+        std::queue <task, std::deque <task, pool_allocator <task>>> tasks_;
+        std::mutex mutex_;
+
+    public:
+        task_queue (void)
+            : tasks_ {}
+        {}
+
+        task_queue (task_queue const &) = delete;
+
+        task_queue (task_queue && other) noexcept
+            : tasks_ (std::move (other).tasks_)
+        {}
+
+        std::pair <bool, task> try_pop (void)
+        {
+            std::unique_lock <std::mutex>
+                lock (this->mutex_, std::try_to_lock);
+            if (!lock || this->tasks_.empty ()) {
+                return std::make_pair (false, task {});
+            } else {
+                auto t = std::move (this->tasks_.front ());
+                this->tasks_.pop ();
+                return std::make_pair (true, std::move (t));
+            }
+        }
+
+        std::pair <bool, task> try_steal (void)
+        {
+            return this->try_pop ();
+        }
+
+        /*
+         * The extra tasks are taken out under this queue's lock but only
+         * pushed onto thief after it has been released, so that two queues
+         * stealing from one another cannot deadlock.
+         */
+        std::pair <bool, task> try_steal_half (task_queue & thief,
+                                               std::size_t & moved)
+        {
+            std::vector <task> batch;
+            task t;
+            {
+                std::unique_lock <std::mutex>
+                    lock (this->mutex_, std::try_to_lock);
+                if (!lock || this->tasks_.empty ())
+                    return std::make_pair (false, task {});
+
+                t = std::move (this->tasks_.front ());
+                this->tasks_.pop ();
+
+                auto const n = this->tasks_.size () / 2;
+                batch.reserve (n);
+                for (std::size_t k = 0; k < n; ++k) {
+                    batch.emplace_back (std::move (this->tasks_.front ()));
+                    this->tasks_.pop ();
                 }
             }
 
-            this->queued_++;
-            this->queues_ [idx % this->nthreads_].push (std::move (t));
+            moved = batch.size ();
+            if (!batch.empty ())
+                thief.push_bulk (batch.data (), batch.data () + batch.size ());
+            return std::make_pair (true, std::move (t));
+        }
+
+        /*
+         * Moves up to max tasks, oldest first, into out; returns the number
+         * of tasks moved, none if the lock is contended.
+         */
+        std::size_t try_pop_bulk (task * out, std::size_t max)
+        {
+            std::unique_lock <std::mutex>
+                lock (this->mutex_, std::try_to_lock);
+            if (!lock)
+                return 0;
+
+            std::size_t n = 0;
+            while (n < max && !this->tasks_.empty ()) {
+                out [n++] = std::move (this->tasks_.front ());
+                this->tasks_.pop ();
+            }
+            return n;
+        }
+
+        bool try_push (task & t)
+        {
+            std::unique_lock <std::mutex>
+                lock (this->mutex_, std::try_to_lock);
+            if (!lock)
+                return false;
+
+            this->tasks_.emplace (std::move (t));
+            return true;
+        }
+
+        void push (task t)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            this->tasks_.emplace (std::move (t));
+        }
+
+        void push_bulk (task * first, task * last)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            for (; first != last; ++first)
+                this->tasks_.emplace (std::move (*first));
+        }
+
+        void push_local (task t)
+        {
+            this->push (std::move (t));
+        }
+
+        bool empty (void)
+        {
+            std::unique_lock <std::mutex> lock (this->mutex_);
+            return this->tasks_.empty ();
+        }
+    };
+
+    /*
+     * work_stealing_queue; the default queue policy of task_system. Each
+     * worker owns a lock-free chase_lev_deque which it pops from in LIFO order
+     * and which other workers steal from; pushes from outside the owning
+     * worker land in a mutex protected inbox (a task_queue), which the owner
+     * drains into its deque in batches so that the rest of that work can be
+     * stolen without touching the inbox lock. The owner runs the tasks of
+     * its inbox in the order they were pushed, as with task_queue; thieves
+     * take the newest of a drained batch first.
+     */
+    class work_stealing_queue
+    {
+        static constexpr std::size_t drain_batch = 32;
+
+        chase_lev_deque <task> deque_;
+        alignas (DSA_CACHE_LINE_SIZE) task_queue inbox_;
+
+    public:
+        work_stealing_queue (void)
+            : deque_ {}
+            , inbox_ {}
+        {}
+
+        work_stealing_queue (work_stealing_queue const &) = delete;
+
+        /*
+         * Queues are only moved while no worker is running, at which point
+         * the deque is necessarily empty.
+         */
+        work_stealing_queue (work_stealing_queue && other) noexcept
+            : deque_ {other.deque_.capacity ()}
+            , inbox_ {std::move (other.inbox_)}
+        {}
+
+        bool try_push (task & t)
+        {
+            return this->inbox_.try_push (t);
+        }
+
+        void push (task t)
+        {
+            this->inbox_.push (std::move (t));
+        }
+
+        void push_bulk (task * first, task * last)
+        {
+            this->inbox_.push_bulk (first, last);
+        }
+
+        /*
+         * Pushes onto the owner's deque, where the task can be stolen without
+         * locking; only if the deque is full does it go to the inbox.
+         */
+        void push_local (task t)
+        {
+            if (!this->deque_.try_push (t))
+                this->inbox_.push (std::move (t));
+        }
+
+        /*
+         * Reports on the deque only; that is, whether there is work here
+         * that thieves could take without the inbox lock.
+         */
+        bool empty (void) const noexcept
+        {
+            return this->deque_.empty ();
+        }
+
+        std::pair <bool, task> try_pop (void)
+        {
+            task t;
+            if (this->deque_.try_pop (t))
+                return std::make_pair (true, std::move (t));
+
+            /*
+             * The batch goes onto the deque newest first, so that the owner's
+             * LIFO pops run it in the order it was pushed, starting with the
+             * oldest task here.
+             */
+            task batch [drain_batch];
+            auto n = this->inbox_.try_pop_bulk (batch, drain_batch);
+            if (n != 0) {
+                while (--n != 0)
+                    this->push_local (std::move (batch [n]));
+                return std::make_pair (true, std::move (batch [0]));
+            }
+
+            return this->inbox_.try_pop ();
+        }
+
+        std::pair <bool, task> try_steal (void)
+        {
+            task t;
+            if (this->deque_.try_steal (t))
+                return std::make_pair (true, std::move (t));
+            return this->inbox_.try_steal ();
+        }
+
+        /*
+         * Steals from the top of the victim's deque straight onto the bottom
+         * of the thief's, at most drain_batch extra tasks at a time; with an
+         * empty deque the victim's inbox is split instead.
+         */
+        std::pair <bool, task> try_steal_half (work_stealing_queue & thief,
+                                               std::size_t & moved)
+        {
+            task t;
+            if (!this->deque_.try_steal (t))
+                return this->inbox_.try_steal_half (thief.inbox_, moved);
+
+            auto const half = this->deque_.size () / 2;
+            auto const n = half < drain_batch ? half : drain_batch;
+            task extra;
+            moved = 0;
+            while (moved < n && this->deque_.try_steal (extra)) {
+                thief.push_local (std::move (extra));
+                ++moved;
+            }
+
+            return std::make_pair (true, std::move (t));
+        }
+    };
+
+namespace detail
+{
+    /*
+     * Tells the processor that the caller is in a spin-wait loop, backing off
+     * the pipeline (and a sibling hyperthread) for a few cycles.
+     */
+    inline void cpu_relax (void) noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause ();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__ ("yield");
+#endif
+    }
+
+    /*
+     * eventcount; lets threads sleep until some condition, checked without
+     * the lock, may have changed. A waiter announces itself with
+     * prepare_wait, checks its condition once more, and then either calls
+     * cancel_wait or blocks in commit_wait with the key it was given; a
+     * notifier that changes the condition before calling notify is therefore
+     * always seen, either by the waiter's check or by commit_wait. notify is
+     * a fence and one load when nobody is waiting.
+     */
+    class eventcount
+    {
+        std::atomic <std::uint64_t> epoch_ {0};
+        std::atomic_size_t waiters_ {0};
+        std::mutex mutex_;
+        std::condition_variable cv_;
+
+        template <class Notify>
+        void notify (Notify && n)
+        {
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            if (this->waiters_.load (std::memory_order_relaxed) == 0)
+                return;
+
+            {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                this->epoch_.fetch_add (1, std::memory_order_relaxed);
+            }
+            n (this->cv_);
+        }
+
+    public:
+        using key_type = std::uint64_t;
+
+        key_type prepare_wait (void) noexcept
+        {
+            this->waiters_.fetch_add (1, std::memory_order_relaxed);
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            return this->epoch_.load (std::memory_order_relaxed);
+        }
+
+        void cancel_wait (void) noexcept
+        {
+            this->waiters_.fetch_sub (1, std::memory_order_relaxed);
+        }
+
+        void commit_wait (key_type key)
+        {
+            {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                while (this->epoch_.load (std::memory_order_relaxed) == key)
+                    this->cv_.wait (lock);
+            }
+            this->waiters_.fetch_sub (1, std::memory_order_relaxed);
+        }
+
+        /*
+         * As commit_wait, giving up after the timeout; returns whether the
+         * waiter was notified.
+         */
+        template <class Rep, class Period>
+        bool commit_wait_for (key_type key,
+                              std::chrono::duration <Rep, Period> timeout)
+        {
+            bool notified;
+            {
+                std::unique_lock <std::mutex> lock (this->mutex_);
+                notified = this->cv_.wait_for (lock, timeout, [&] (void) {
+                    return this->epoch_.load (std::memory_order_relaxed) != key;
+                });
+            }
+            this->waiters_.fetch_sub (1, std::memory_order_relaxed);
+            return notified;
+        }
+
+        std::size_t waiters (void) const noexcept
+        {
+            return this->waiters_.load (std::memory_order_relaxed);
+        }
+
+        void notify_one (void)
+        {
+            this->notify ([] (std::condition_variable & cv) {
+                cv.notify_one ();
+            });
+        }
+
+        void notify_all (void)
+        {
+            this->notify ([] (std::condition_variable & cv) {
+                cv.notify_all ();
+            });
+        }
+    };
+
+#ifdef DSA_TASK_TRACE
+    enum class trace_kind : unsigned
+    {
+        run,
+        steal,
+        park
+    };
+
+    struct trace_record
+    {
+        trace_kind kind;
+        char const * name;
+        std::uint64_t begin;
+        std::uint64_t end;
+        std::uint64_t arg;
+    };
+
+    /*
+     * trace_buffer; a fixed size ring of the most recent events of one
+     * worker. Only the owner records, without locking or allocating; a
+     * reader may copy the ring out at any time. The owner bumps reserved_
+     * before overwriting a slot and committed_ after, so that a reader can
+     * tell which of the slots it copied may have been overwritten meanwhile
+     * and drop them, as with a seqlock.
+     */
+    class trace_buffer
+    {
+        struct slot
+        {
+            std::atomic <unsigned> kind;
+            std::atomic <char const *> name;
+            std::atomic <std::uint64_t> begin;
+            std::atomic <std::uint64_t> end;
+            std::atomic <std::uint64_t> arg;
+        };
+
+        std::unique_ptr <slot []> slots_;
+        std::size_t capacity_;
+        std::atomic <std::uint64_t> reserved_ {0};
+        std::atomic <std::uint64_t> committed_ {0};
+
+    public:
+        /*
+         * The slots are value initialized, so that every page of the buffer
+         * has been touched before the first event is recorded.
+         */
+        explicit trace_buffer (std::size_t capacity = DSA_TASK_TRACE_EVENTS)
+            : slots_    {new slot [capacity] ()}
+            , capacity_ {capacity}
+        {}
+
+        void record (trace_kind kind, char const * name,
+                     std::uint64_t begin, std::uint64_t end,
+                     std::uint64_t arg = 0) noexcept
+        {
+            auto const n = this->committed_.load (std::memory_order_relaxed);
+            auto & s = this->slots_ [n % this->capacity_];
+
+            this->reserved_.store (n + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence (std::memory_order_release);
+            s.kind.store  (static_cast <unsigned> (kind),
+                           std::memory_order_relaxed);
+            s.name.store  (name, std::memory_order_relaxed);
+            s.begin.store (begin, std::memory_order_relaxed);
+            s.end.store   (end, std::memory_order_relaxed);
+            s.arg.store   (arg, std::memory_order_relaxed);
+            this->committed_.store (n + 1, std::memory_order_release);
+        }
+
+        void copy_to (std::vector <trace_record> & out) const
+        {
+            auto const last = this->committed_.load (std::memory_order_acquire);
+            auto const first =
+                last > this->capacity_ ? last - this->capacity_ : 0;
+
+            auto const start = out.size ();
+            for (auto n = first; n < last; ++n) {
+                auto const & s = this->slots_ [n % this->capacity_];
+                out.push_back (trace_record {
+                    static_cast <trace_kind> (
+                        s.kind.load (std::memory_order_relaxed)
+                    ),
+                    s.name.load  (std::memory_order_relaxed),
+                    s.begin.load (std::memory_order_relaxed),
+                    s.end.load   (std::memory_order_relaxed),
+                    s.arg.load   (std::memory_order_relaxed)
+                });
+            }
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+            auto const reserved =
+                this->reserved_.load (std::memory_order_relaxed);
+            if (reserved > first + this->capacity_) {
+                auto const torn = std::min <std::uint64_t> (
+                    reserved - first - this->capacity_, last - first
+                );
+                out.erase (
+                    out.begin () + static_cast <std::ptrdiff_t> (start),
+                    out.begin () + static_cast <std::ptrdiff_t> (start + torn)
+                );
+            }
+        }
+    };
+
+    /*
+     * Writes s as a JSON string literal.
+     */
+    inline void write_json_string (std::ostream & out, char const * s)
+    {
+        static char const hex [] = "0123456789abcdef";
+
+        out << '"';
+        for (; *s; ++s) {
+            auto const c = static_cast <unsigned char> (*s);
+            if (c == '"' || c == '\\')
+                out << '\\' << *s;
+            else if (c < 0x20)
+                out << "\\u00" << hex [c >> 4] << hex [c & 0xf];
+            else
+                out << *s;
+        }
+        out << '"';
+    }
+
+    /*
+     * Writes a duration in nanoseconds as microseconds, the unit of the
+     * Chrome trace format, keeping nanosecond precision.
+     */
+    inline void write_micros (std::ostream & out, std::uint64_t ns)
+    {
+        auto const frac = ns % 1000;
+        out << ns / 1000 << '.'
+            << static_cast <char> ('0' + frac / 100)
+            << static_cast <char> ('0' + frac / 10 % 10)
+            << static_cast <char> ('0' + frac % 10);
+    }
+#endif
+
+    /*
+     * cpu_topology; the CPUs this process may run on, grouped by NUMA node as
+     * described by Linux sysfs and restricted to the process's affinity
+     * mask. Elsewhere, or if sysfs cannot be read, all CPUs are taken to form
+     * a single node.
+     */
+    struct cpu_topology
+    {
+        std::vector <std::vector <int>> nodes;
+
+        /*
+         * Parses the sysfs list format, e.g. "0-3,8-11".
+         */
+        static std::vector <int> parse_list (std::string const & s)
+        {
+            std::vector <int> out;
+            std::size_t i = 0;
+            while (i < s.size ()) {
+                std::size_t end;
+                int first;
+                try {
+                    first = std::stoi (s.substr (i), &end);
+                } catch (std::exception const &) {
+                    break;
+                }
+
+                i += end;
+                auto last = first;
+                if (i < s.size () && s [i] == '-') {
+                    ++i;
+                    try {
+                        last = std::stoi (s.substr (i), &end);
+                    } catch (std::exception const &) {
+                        break;
+                    }
+                    i += end;
+                }
+                for (auto c = first; c <= last; ++c)
+                    out.push_back (c);
+
+                while (i < s.size () && (s [i] == ',' || s [i] == '\n'))
+                    ++i;
+            }
+            return out;
+        }
+
+        static bool allowed (int cpu) noexcept
+        {
+#if defined(__linux__)
+            static cpu_set_t const mask = [] (void) {
+                cpu_set_t m;
+                CPU_ZERO (&m);
+                if (sched_getaffinity (0, sizeof (m), &m) != 0)
+                    for (int c = 0; c < CPU_SETSIZE; ++c)
+                        CPU_SET (static_cast <std::size_t> (c), &m);
+                return m;
+            } ();
+            return cpu >= 0 && cpu < CPU_SETSIZE &&
+                CPU_ISSET (static_cast <std::size_t> (cpu), &mask);
+#else
+            return cpu >= 0;
+#endif
+        }
+
+        static cpu_topology discover (
+            std::string const & root = "/sys/devices/system/node")
+        {
+            cpu_topology t;
+
+            std::string line;
+            std::ifstream online (root + "/online");
+            if (std::getline (online, line)) {
+                for (auto node : parse_list (line)) {
+                    std::ifstream f (
+                        root + "/node" + std::to_string (node) + "/cpulist"
+                    );
+                    std::vector <int> cpus;
+                    if (std::getline (f, line))
+                        for (auto c : parse_list (line))
+                            if (allowed (c))
+                                cpus.push_back (c);
+                    if (!cpus.empty ())
+                        t.nodes.emplace_back (std::move (cpus));
+                }
+            }
+
+            if (t.nodes.empty ()) {
+                std::vector <int> cpus;
+                auto const n = static_cast <int> (
+                    std::max (1u, std::thread::hardware_concurrency ())
+                );
+                for (int c = 0; c < n; ++c)
+                    if (allowed (c))
+                        cpus.push_back (c);
+                t.nodes.emplace_back (std::move (cpus));
+            }
+            return t;
+        }
+    };
+
+    /*
+     * Binds the calling thread to the given CPU; a no-op where that is not
+     * supported.
+     */
+    inline void pin_this_thread (int cpu) noexcept
+    {
+#if defined(__linux__)
+        cpu_set_t m;
+        CPU_ZERO (&m);
+        CPU_SET (static_cast <std::size_t> (cpu), &m);
+        pthread_setaffinity_np (pthread_self (), sizeof (m), &m);
+#else
+        (void) cpu;
+#endif
+    }
+
+    template <class System>
+    struct task_system_access;
+
+#ifdef DSA_TASK_COROUTINES
+    /*
+     * The awaiter returned by task_system::schedule; the awaiting coroutine
+     * is resumed by a detached task on one of the system's workers.
+     */
+    template <class System>
+    struct schedule_awaiter
+    {
+        System & system;
+
+        bool await_ready (void) const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend (std::coroutine_handle <> h)
+        {
+            this->system.post ([h] (void) { h.resume (); });
+        }
+
+        void await_resume (void) const noexcept
+        {}
+    };
+#endif
+}   // namespace detail
+
+    /*
+     * idle_policy; how long an out of work worker keeps looking before it
+     * goes to sleep. It first polls the queues spin_limit times, pausing the
+     * processor between polls, then yield_limit times, yielding its time
+     * slice between polls, and then parks until new work is pushed. Spinning
+     * longer trades processor time (and power) for wakeup latency.
+     */
+    struct idle_policy
+    {
+        std::size_t spin_limit;
+        std::size_t yield_limit;
+
+        constexpr idle_policy (std::size_t spin = 64, std::size_t yield = 8)
+            : spin_limit  {spin}
+            , yield_limit {yield}
+        {}
+
+        static constexpr idle_policy low_latency (void)
+        {
+            return idle_policy {4096, 256};
+        }
+
+        static constexpr idle_policy low_power (void)
+        {
+            return idle_policy {0, 1};
+        }
+    };
+
+    /*
+     * priority; the lane a task is queued in. Each worker has one queue per
+     * lane and takes (and steals) work from the highest non-empty lane first;
+     * see task_system::starvation_limit for how lower lanes still progress.
+     */
+    enum class priority
+    {
+        high,
+        normal,
+        background
+    };
+
+    /*
+     * resize_policy; the bounds within which a task_system sizes itself. It
+     * starts min_threads workers. While more than backlog tasks per worker
+     * are queued, beyond one for each parked worker, each push may start
+     * another, up to max_threads; a worker above min_threads that parks
+     * for idle_timeout without being woken retires. Workers are numbered
+     * densely, so it is always the highest numbered worker that retires.
+     */
+    struct resize_policy
+    {
+        std::size_t min_threads;
+        std::size_t max_threads;
+        std::chrono::milliseconds idle_timeout;
+        std::size_t backlog;
+
+        constexpr resize_policy (
+            std::size_t min, std::size_t max,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds {1000},
+            std::size_t per_worker = 8)
+            : min_threads  {min}
+            , max_threads  {max}
+            , idle_timeout {timeout}
+            , backlog      {per_worker}
+        {}
+    };
+
+    /*
+     * placement; with placement::numa, worker threads are pinned to CPUs of
+     * the machine's NUMA nodes, workers on the same node are grouped
+     * together, and thieves look for work on their own node before crossing
+     * to another. Memory the pinned workers allocate for tasks comes from
+     * their own thread-local pools, and so, under the usual first-touch
+     * policy, from their own node.
+     */
+    enum class placement
+    {
+        none,
+        numa
+    };
+
+    /*
+     * numa_node; directs a push to the workers of one NUMA node (see
+     * placement). Indices beyond the number of nodes wrap around.
+     */
+    struct numa_node
+    {
+        std::size_t index;
+    };
+
+namespace detail
+{
+    /*
+     * Leading arguments to push and post that select where a task goes, as
+     * opposed to the callable itself.
+     */
+    template <class T>
+    struct is_push_option : std::false_type {};
+
+    template <>
+    struct is_push_option <priority> : std::true_type {};
+
+    template <>
+    struct is_push_option <numa_node> : std::true_type {};
+}   // namespace detail
+
+    class cancellation_source;
+
+    /*
+     * cancellation_token; an observer of a cancellation_source. A default
+     * constructed token is never cancelled.
+     */
+    class cancellation_token
+    {
+        std::shared_ptr <std::atomic_bool const> state_;
+
+        friend class cancellation_source;
+
+        explicit cancellation_token (
+            std::shared_ptr <std::atomic_bool const> state) noexcept
+            : state_ (std::move (state))
+        {}
+
+    public:
+        cancellation_token (void) noexcept = default;
+
+        bool cancelled (void) const noexcept
+        {
+            return this->state_ &&
+                this->state_->load (std::memory_order_acquire);
+        }
+    };
+
+    /*
+     * cancellation_source; cancels every task pushed with one of its tokens
+     * that has not yet started running. Cancellation cannot be undone.
+     */
+    class cancellation_source
+    {
+        std::shared_ptr <std::atomic_bool> state_;
+
+    public:
+        cancellation_source (void)
+            : state_ (std::make_shared <std::atomic_bool> (false))
+        {}
+
+        void cancel (void) noexcept
+        {
+            this->state_->store (true, std::memory_order_release);
+        }
+
+        bool cancelled (void) const noexcept
+        {
+            return this->state_->load (std::memory_order_acquire);
+        }
+
+        cancellation_token token (void) const noexcept
+        {
+            return cancellation_token (this->state_);
+        }
+    };
+
+    /*
+     * cancellation; a leading argument to push and post that drops the task
+     * instead of running it if, by the time a worker takes it from a queue,
+     * its token has been cancelled or its deadline has passed. The future of
+     * a dropped task holds a task_cancelled exception.
+     */
+    struct cancellation
+    {
+        using clock = std::chrono::steady_clock;
+
+        cancellation_token token;
+        clock::time_point deadline;
+
+        cancellation (cancellation_token t) noexcept
+            : token    (std::move (t))
+            , deadline (clock::time_point::max ())
+        {}
+
+        cancellation (clock::time_point d) noexcept
+            : token    {}
+            , deadline (d)
+        {}
+
+        cancellation (cancellation_token t, clock::time_point d) noexcept
+            : token    (std::move (t))
+            , deadline (d)
+        {}
+
+        bool requested (void) const noexcept
+        {
+            return this->token.cancelled () ||
+                (this->deadline != clock::time_point::max () &&
+                 clock::now () >= this->deadline);
+        }
+    };
+
+    /*
+     * The exception held by the future of a task dropped by its cancellation.
+     */
+    class task_cancelled : public std::runtime_error
+    {
+    public:
+        task_cancelled (void)
+            : std::runtime_error ("task cancelled")
+        {}
+    };
+
+namespace detail
+{
+    template <>
+    struct is_push_option <cancellation> : std::true_type {};
+
+    template <>
+    struct is_push_option <cancellation_token> : std::true_type {};
+
+    template <>
+    struct is_push_option <cancellation::clock::time_point>
+        : std::true_type {};
+
+    /*
+     * Wraps the callable of a task pushed with a cancellation. The worker
+     * checks it through cancel_traits as it takes the task from a queue,
+     * and calls a cancelled task at once only so that it reports itself
+     * dropped: tasks with a future throw task_cancelled into it, and
+     * detached ones are dropped silently.
+     */
+    template <class F>
+    struct cancellable_base
+    {
+        cancellation cancel;
+        std::atomic <std::uint64_t> * dropped;
+        F fn;
+
+        template <class G>
+        cancellable_base (cancellation c, std::atomic <std::uint64_t> * d,
+                          G && g)
+            : cancel  (std::move (c))
+            , dropped (d)
+            , fn      (std::forward <G> (g))
+        {}
+
+        bool drop (void) const noexcept
+        {
+            if (!this->cancel.requested ())
+                return false;
+
+            this->dropped->fetch_add (1, std::memory_order_relaxed);
+            return true;
+        }
+    };
+
+    template <class F, bool Detached>
+    struct cancellable : cancellable_base <F>
+    {
+        using cancellable_base <F>::cancellable_base;
+
+        template <class ... Args>
+        auto operator() (Args && ... args)
+            -> decltype (utility::invoke (
+                std::declval <F &> (), std::forward <Args> (args)...
+            ))
+        {
+            if (this->drop ())
+                throw task_cancelled {};
+            return utility::invoke (this->fn, std::forward <Args> (args)...);
+        }
+    };
+
+    template <class F>
+    struct cancellable <F, true> : cancellable_base <F>
+    {
+        using cancellable_base <F>::cancellable_base;
+
+        template <class ... Args>
+        void operator() (Args && ... args)
+        {
+            if (!this->drop ())
+                utility::invoke (this->fn, std::forward <Args> (args)...);
+        }
+    };
+
+    template <class F, bool Detached>
+    struct label_traits <cancellable <F, Detached>>
+    {
+        static char const * of (cancellable <F, Detached> const & f) noexcept
+        {
+            return label_of (f.fn);
+        }
+    };
+
+    template <class F, bool Detached>
+    struct cancel_traits <cancellable <F, Detached>>
+    {
+        static bool requested (cancellable <F, Detached> const & f) noexcept
+        {
+            return f.cancel.requested ();
+        }
+    };
+}   // namespace detail
+
+    /*
+     * steal_mode; whether a thief takes a single task from its victim or, in
+     * addition, half of what remains there, so that a deep queue is spread
+     * out with one steal rather than one per task.
+     */
+    enum class steal_mode
+    {
+        single,
+        half
+    };
+
+    /*
+     * overflow; what a push does when the task_system's queue limit is
+     * reached (see task_system::set_queue_limit). With block, the pushing
+     * thread waits until workers have taken enough tasks off the queues;
+     * with run_on_caller, the task is run at once on the pushing thread.
+     */
+    enum class overflow
+    {
+        block,
+        run_on_caller
+    };
+
+    /*
+     * steal_stats; totals over all workers since the task_system started.
+     * Every probe of another worker's queue is an attempt, and is counted
+     * either as a success or a failure; tasks counts all tasks taken by
+     * successful attempts, including those moved over by steal_mode::half.
+     */
+    struct steal_stats
+    {
+        std::uint64_t attempts;
+        std::uint64_t successes;
+        std::uint64_t failures;
+        std::uint64_t tasks;
+    };
+
+#ifdef DSA_TASK_STATS
+    /*
+     * latency_histogram; durations in nanoseconds counted in power of two
+     * buckets. counts [0] holds durations under 2 ns, counts [k] those in
+     * [2^k, 2^(k + 1)), and the last bucket everything longer (2^39 ns is
+     * about nine minutes).
+     */
+    struct latency_histogram
+    {
+        static constexpr std::size_t buckets = 40;
+
+        std::uint64_t counts [buckets];
+
+        static std::size_t bucket_of (std::uint64_t ns) noexcept
+        {
+#if defined(__GNUC__)
+            auto const k = static_cast <std::size_t> (
+                63 - __builtin_clzll (ns | 1)
+            );
+#else
+            std::size_t k = 0;
+            while (ns >>= 1)
+                ++k;
+#endif
+            return k < buckets ? k : buckets - 1;
+        }
+
+        std::uint64_t total (void) const noexcept
+        {
+            std::uint64_t n = 0;
+            for (auto c : this->counts)
+                n += c;
+            return n;
+        }
+
+        /*
+         * An upper bound on the q-quantile, 0 <= q <= 1, of the recorded
+         * durations: the upper edge of the bucket that holds it.
+         */
+        std::uint64_t quantile (double q) const noexcept
+        {
+            auto const n = this->total ();
+            if (n == 0)
+                return 0;
+
+            auto const rank = static_cast <std::uint64_t> (
+                q * static_cast <double> (n - 1)
+            );
+            std::uint64_t seen = 0;
+            for (std::size_t k = 0; k < buckets; ++k) {
+                seen += this->counts [k];
+                if (seen > rank)
+                    return (std::uint64_t {2} << k) - 1;
+            }
+            return ~std::uint64_t {0};
+        }
+
+        latency_histogram & operator+= (latency_histogram const & other)
+            noexcept
+        {
+            for (std::size_t k = 0; k < buckets; ++k)
+                this->counts [k] += other.counts [k];
+            return *this;
+        }
+    };
+
+    /*
+     * worker_stats; what one worker has done since it was first started.
+     * Time parked counts only time blocked waiting for work, not spinning or
+     * yielding, and is added when the worker wakes. queue_wait measures from
+     * push until the task started running, and run_time how long it ran.
+     */
+    struct worker_stats
+    {
+        std::uint64_t executed;
+        std::uint64_t steals;
+        std::uint64_t failed_steals;
+        std::uint64_t parked_ns;
+        std::uint64_t running_ns;
+        latency_histogram queue_wait;
+        latency_histogram run_time;
+
+        worker_stats & operator+= (worker_stats const & other) noexcept
+        {
+            this->executed      += other.executed;
+            this->steals        += other.steals;
+            this->failed_steals += other.failed_steals;
+            this->parked_ns     += other.parked_ns;
+            this->running_ns    += other.running_ns;
+            this->queue_wait    += other.queue_wait;
+            this->run_time      += other.run_time;
+            return *this;
+        }
+    };
+
+    /*
+     * scheduler_stats; a snapshot of every worker slot of a task_system,
+     * together with their sum.
+     */
+    struct scheduler_stats
+    {
+        std::vector <worker_stats> workers;
+        worker_stats total;
+    };
+#endif
+
+    /*
+     * task_system; a work-stealing tasking system partly inspired by Sean
+     * Parent's "Better Code: Concurrency" talk; see http://sean-parent.stlab.cc
+     *
+     * The Queue parameter selects the per-worker queue policy; see task_queue
+     * for the requirements. The default, work_stealing_queue, is lock-free on
+     * the worker side; task_queue is the plain mutex protected alternative.
+     *
+     * A task_system is aligned to DSA_CACHE_LINE_SIZE; before C++17,
+     * operator new does not honour that alignment, which costs placing its
+     * shared counters on lines of their own but is otherwise harmless.
+     */
+    template <class Allocator = pool_allocator <task>,
+              class Queue = work_stealing_queue>
+    class task_system
+    {
+    public:
+        using exception_handler = std::function <void (std::exception_ptr)>;
+
+        /*
+         * The number of tasks a worker takes in a row from the higher lanes
+         * before it looks in the background lane first; this bounds how long
+         * background work can be starved by a steady stream of higher
+         * priority tasks.
+         */
+        static constexpr std::size_t starvation_limit = 32;
+
+    private:
+        using task_queue = Queue;
+
+        detail::cache_aligned_vector <detail::cache_aligned <task_queue>>
+            queues_;
+        std::vector <std::thread> threads_;
+        typename std::allocator_traits <Allocator>::template rebind_alloc <
+            task::task_concept
+        > alloc_;
+        /*
+         * Queue and thread storage is allocated for capacity_ workers up
+         * front and never moves. Workers [0, live_) are running; thieves look
+         * at every worker below started_, the highest live_ has ever been,
+         * since a retired worker's queues may still hold tasks pushed to it
+         * as it retired.
+         */
+        std::size_t capacity_;
+        std::atomic_size_t live_ {0};
+        std::atomic_size_t started_ {0};
+        std::atomic_size_t min_threads_;
+        std::atomic_size_t max_threads_;
+        std::chrono::milliseconds idle_timeout_;
+        std::size_t backlog_;
+        std::mutex resize_mutex_;
+        idle_policy idle_;
+        std::atomic <steal_mode> steal_mode_ {steal_mode::half};
+        std::atomic_size_t queue_limit_ {0};
+        std::atomic <overflow> overflow_ {overflow::block};
+        static constexpr std::size_t priority_lanes = 3;
+
+        /*
+         * The counters below are written on every push, and the first two
+         * also on every pop and completion, by all threads; each gets its own
+         * cache line so that they neither share one with each other nor with
+         * the read-mostly settings above.
+         *
+         * queued_ is per lane; see push_shared for how these are kept
+         * consistent.
+         */
+        alignas (DSA_CACHE_LINE_SIZE)
+            std::atomic_size_t queued_ [priority_lanes] {{0}, {0}, {0}};
+
+        /*
+         * The tasks counted against the queue limit: every task queued and
+         * not yet taken, reserved before it is pushed; see admit.
+         */
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic_size_t admitted_ {0};
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic_size_t outstanding_ {0};
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic_size_t current_index_ {0};
+        alignas (DSA_CACHE_LINE_SIZE) detail::eventcount work_available_;
+        alignas (DSA_CACHE_LINE_SIZE) detail::eventcount space_available_;
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic_size_t idle_waiters_ {0};
+        alignas (DSA_CACHE_LINE_SIZE) std::atomic <std::uint64_t> dropped_ {0};
+        std::atomic_bool done_ {false};
+        std::mutex idle_mutex_;
+        std::condition_variable idle_cv_;
+        exception_handler handler_;
+        std::mutex handler_mutex_;
+
+        /*
+         * Only ever written by their own worker, so updates are plain relaxed
+         * stores.
+         */
+        struct steal_counters
+        {
+            std::atomic <std::uint64_t> attempts {0};
+            std::atomic <std::uint64_t> successes {0};
+            std::atomic <std::uint64_t> tasks {0};
+
+            void add (std::atomic <std::uint64_t> & c, std::uint64_t n)
+                noexcept
+            {
+                c.store (
+                    c.load (std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed
+                );
+            }
+        };
+
+#ifdef DSA_TASK_STATS
+        struct worker_counters
+        {
+            std::atomic <std::uint64_t> executed {0};
+            std::atomic <std::uint64_t> parked_ns {0};
+            std::atomic <std::uint64_t> running_ns {0};
+            std::atomic <std::uint64_t>
+                queue_wait [latency_histogram::buckets] {};
+            std::atomic <std::uint64_t>
+                run_time [latency_histogram::buckets] {};
+
+            static void add (std::atomic <std::uint64_t> & c, std::uint64_t n)
+                noexcept
+            {
+                c.store (
+                    c.load (std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed
+                );
+            }
+
+            static void read (std::atomic <std::uint64_t> const * c,
+                              latency_histogram & h) noexcept
+            {
+                for (std::size_t k = 0; k < latency_histogram::buckets; ++k)
+                    h.counts [k] = c [k].load (std::memory_order_relaxed);
+            }
+        };
+
+#endif
+
+        /*
+         * Everything kept per worker slot, on cache lines of its own. Besides
+         * the worker itself, exited is only written under idle_mutex_, when
+         * the slot is started and when its worker has finished. expired is
+         * set while the worker's idle timeout has run out but it could not
+         * yet retire, not being the highest numbered.
+         */
+        struct alignas (DSA_CACHE_LINE_SIZE) worker_state
+        {
+            std::atomic_bool exited {true};
+            std::atomic_bool expired {false};
+            steal_counters steals;
+#ifdef DSA_TASK_STATS
+            worker_counters stats;
+#endif
+#ifdef DSA_TASK_TRACE
+            detail::trace_buffer trace;
+#endif
+        };
+
+        detail::cache_aligned_vector <worker_state> workers_;
+
+#ifdef DSA_TASK_TRACE
+        std::uint64_t trace_epoch_;
+#endif
+
+        /*
+         * Worker placement; without placement::numa there is one node
+         * holding every worker and no worker is pinned. victims_ [id] lists
+         * the other workers on id's node, local_victims_ [id] of them, then
+         * those on every other node.
+         */
+        std::vector <int> cpu_of_;
+        std::vector <std::size_t> node_of_;
+        std::vector <std::vector <std::size_t>> node_workers_;
+        std::vector <std::vector <std::size_t>> victims_;
+        std::vector <std::size_t> local_victims_;
+
+        void place_workers (placement place)
+        {
+            auto const n = this->capacity_;
+            this->cpu_of_.assign (n, -1);
+            this->node_of_.assign (n, 0);
+
+            auto const topo = place == placement::numa ?
+                detail::cpu_topology::discover () : detail::cpu_topology {};
+            std::vector <std::pair <int, std::size_t>> cpus;
+            for (std::size_t node = 0; node < topo.nodes.size (); ++node)
+                for (auto c : topo.nodes [node])
+                    cpus.emplace_back (c, node);
+
+            if (!cpus.empty ()) {
+                /*
+                 * Spread the workers evenly over the CPUs, in node order, so
+                 * that consecutive workers share a node.
+                 */
+                for (std::size_t id = 0; id < n; ++id) {
+                    auto const & c = cpus [id * cpus.size () / n];
+                    this->cpu_of_ [id] = c.first;
+                    this->node_of_ [id] = c.second;
+                }
+                this->node_workers_.assign (
+                    topo.nodes.size (), std::vector <std::size_t> {}
+                );
+            } else {
+                this->node_workers_.assign (1, std::vector <std::size_t> {});
+            }
+
+            for (std::size_t id = 0; id < n; ++id)
+                this->node_workers_ [this->node_of_ [id]].push_back (id);
+
+            for (std::size_t id = 0; id < n; ++id) {
+                std::vector <std::size_t> order;
+                for (auto v : this->node_workers_ [this->node_of_ [id]])
+                    if (v != id)
+                        order.push_back (v);
+                this->local_victims_.push_back (order.size ());
+                for (std::size_t v = 0; v < n; ++v)
+                    if (this->node_of_ [v] != this->node_of_ [id])
+                        order.push_back (v);
+                this->victims_.emplace_back (std::move (order));
+            }
+        }
+
+        template <class>
+        friend struct detail::task_system_access;
+
+        /*
+         * Identifies the task_system and worker index, if any, that the
+         * calling thread belongs to.
+         */
+        struct worker_info
+        {
+            task_system const * system;
+            std::size_t index;
+            std::uint64_t rng;
+            std::size_t picks;
+        };
+
+        static worker_info & this_worker (void) noexcept
+        {
+            thread_local worker_info w {nullptr, 0, 0, 0};
+            return w;
+        }
+
+        static std::size_t lane_of (priority p) noexcept
+        {
+            return static_cast <std::size_t> (p);
+        }
+
+        task_queue & queue (std::size_t id, std::size_t lane) noexcept
+        {
+            return this->queues_ [lane * this->capacity_ + id];
+        }
+
+        std::size_t queued (void) const noexcept
+        {
+            std::size_t n = 0;
+            for (auto const & q : this->queued_)
+                n += q.load (std::memory_order_relaxed);
+            return n;
+        }
+
+        /*
+         * xorshift64 (Marsaglia, "Xorshift RNGs", 2003) over the calling
+         * worker's own state.
+         */
+        static std::uint64_t next_random (void) noexcept
+        {
+            auto & x = this_worker ().rng;
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            return x;
+        }
+
+        bool in_worker (std::size_t & id) const noexcept
+        {
+            auto const & w = this_worker ();
+            id = w.index;
+            return w.system == this;
+        }
+
+        /*
+         * Only detached tasks (see post) let exceptions escape; those are
+         * routed to the exception handler, or terminate the program if none
+         * is set, as they would from a std::thread.
+         */
+        void call (task & t) noexcept
+        {
+            try {
+                t ();
+            } catch (...) {
+                exception_handler h;
+                {
+                    std::unique_lock <std::mutex> lock (this->handler_mutex_);
+                    h = this->handler_;
+                }
+
+                if (h)
+                    h (std::current_exception ());
+                else
+                    std::terminate ();
+            }
+        }
+
+        void invoke (std::size_t id, task & t) noexcept
+        {
+#if defined(DSA_TASK_STATS) || defined(DSA_TASK_TRACE)
+            auto const start = detail::clock_ns ();
+#endif
+#ifdef DSA_TASK_STATS
+            auto & st = this->workers_ [id].stats;
+            worker_counters::add (st.queue_wait [latency_histogram::bucket_of (
+                start > t._pushed ? start - t._pushed : 0
+            )], 1);
+#else
+            (void) id;
+#endif
+            this->call (t);
+
+#if defined(DSA_TASK_STATS) || defined(DSA_TASK_TRACE)
+            auto const stop = detail::clock_ns ();
+#endif
+#ifdef DSA_TASK_STATS
+            worker_counters::add (st.executed, 1);
+            worker_counters::add (st.running_ns, stop - start);
+            worker_counters::add (
+                st.run_time [latency_histogram::bucket_of (stop - start)], 1
+            );
+#endif
+#ifdef DSA_TASK_TRACE
+            this->workers_ [id].trace.record (
+                detail::trace_kind::run, t._label, start, stop
+            );
+#endif
+            this->task_done ();
+        }
+
+        /*
+         * outstanding_ counts tasks from push until they have finished
+         * running. Waiters are only notified, under the mutex, when it drops
+         * to zero while someone is waiting; since a waiter registers itself
+         * before checking the count, one of the two always sees the other.
+         */
+        void task_done (void) noexcept
+        {
+            if (this->outstanding_.fetch_sub (1) == 1 &&
+                this->idle_waiters_.load () != 0)
+            {
+                std::unique_lock <std::mutex> lock (this->idle_mutex_);
+                this->idle_cv_.notify_all ();
+            }
+        }
+
+        template <class Predicate>
+        void wait_until (Predicate && pred)
+        {
+            std::unique_lock <std::mutex> lock (this->idle_mutex_);
+            this->idle_waiters_++;
+            while (!pred ())
+                this->idle_cv_.wait (lock);
+            this->idle_waiters_--;
+        }
+
+        bool all_exited (void) const
+        {
+            return std::all_of (
+                this->workers_.begin (), this->workers_.end (),
+                [] (worker_state const & w) { return w.exited.load (); }
+            );
+        }
+
+        /*
+         * Looks through the lanes from high to background, skipping those
+         * with nothing queued. After starvation_limit tasks in a row have
+         * been taken by this worker without the background lane being
+         * served, the order is reversed for one pick.
+         */
+        bool find_work (std::size_t id, task & t)
+        {
+            auto & w = this_worker ();
+            auto const aging = w.picks >= starvation_limit;
+
+            for (std::size_t k = 0; k < priority_lanes; ++k) {
+                auto const lane = aging ? priority_lanes - 1 - k : k;
+                if (this->queued_ [lane].load (std::memory_order_relaxed) != 0
+                    && this->find_in_lane (id, lane, t))
+                {
+                    if (aging || lane == priority_lanes - 1)
+                        w.picks = 0;
+                    else
+                        w.picks++;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /*
+         * One pass over a lane: worker id's own queue first, then every other
+         * worker's, starting from a random victim so that thieves spread out
+         * rather than all descending on the same neighbour.
+         */
+        bool find_in_lane (std::size_t id, std::size_t lane, task & t)
+        {
+            while (true) {
+                auto p = this->queue (id, lane).try_pop ();
+                if (!p.first && this->capacity_ > 1)
+                    p = this->steal (id, lane);
+                if (!p.first)
+                    return false;
+
+                this->queued_ [lane]--;
+                this->release (1);
+                if (!p.second.cancelled ()) {
+                    t = std::move (p.second);
+                    return true;
+                }
+
+                /*
+                 * Dropped as it is taken, whether popped or stolen, rather
+                 * than dispatched; calling it only fails its future with
+                 * task_cancelled, and it is not counted as executed.
+                 */
+                this->call (p.second);
+                this->task_done ();
+            }
+        }
+
+        /*
+         * Tries the workers on id's own node first and then the rest, each
+         * group from a random starting point.
+         */
+        std::pair <bool, task> steal (std::size_t id, std::size_t lane)
+        {
+            auto const & victims = this->victims_ [id];
+            auto const local = this->local_victims_ [id];
+
+            auto p = this->steal_from (id, lane, victims.data (), local);
+            if (!p.first)
+                p = this->steal_from (
+                    id, lane, victims.data () + local, victims.size () - local
+                );
+            return p;
+        }
+
+        std::pair <bool, task> steal_from (std::size_t id, std::size_t lane,
+                                           std::size_t const * victims,
+                                           std::size_t n)
+        {
+            if (n == 0)
+                return std::make_pair (false, task {});
+
+            auto const half =
+                this->steal_mode_.load (std::memory_order_relaxed) ==
+                    steal_mode::half;
+            auto & thief = this->queue (id, lane);
+            auto & counters = this->workers_ [id].steals;
+
+            auto const started =
+                this->started_.load (std::memory_order_relaxed);
+            auto const start = static_cast <std::size_t> (next_random () % n);
+            for (std::size_t k = 0; k < n; ++k) {
+                auto const v = victims [(start + k) % n];
+                if (v >= started)
+                    continue;
+                auto & victim = this->queue (v, lane);
+
+                std::size_t moved = 0;
+                auto p = half ? victim.try_steal_half (thief, moved)
+                              : victim.try_steal ();
+
+                counters.add (counters.attempts, 1);
+                if (p.first) {
+                    counters.add (counters.successes, 1);
+                    counters.add (counters.tasks, 1 + moved);
+#ifdef DSA_TASK_TRACE
+                    auto const now = detail::clock_ns ();
+                    this->workers_ [id].trace.record (
+                        detail::trace_kind::steal, nullptr, now, now, v
+                    );
+#endif
+                    return p;
+                }
+            }
+            return std::make_pair (false, task {});
+        }
+
+        /*
+         * Polls for work as set out by the idle policy, skipping the scan
+         * while the queued count says there is nothing to find, and finally
+         * parks on work_available_. Returns false once done has been called
+         * and no queued work remains.
+         */
+        bool wait_for_work (std::size_t id, task & t)
+        {
+            for (std::size_t k = 0; k < this->idle_.spin_limit; ++k) {
+                if (this->queued () != 0 && this->find_work (id, t))
+                    return true;
+                detail::cpu_relax ();
+            }
+
+            for (std::size_t k = 0; k < this->idle_.yield_limit; ++k) {
+                if (this->queued () != 0 && this->find_work (id, t))
+                    return true;
+                std::this_thread::yield ();
+            }
+
+            auto & self = this->workers_ [id];
+            while (true) {
+                auto const key = this->work_available_.prepare_wait ();
+                if (this->find_work (id, t)) {
+                    this->work_available_.cancel_wait ();
+                    self.expired.store (false, std::memory_order_relaxed);
+                    return true;
+                } else if ((this->done_.load () && this->queued () == 0) ||
+                           ((id >= this->max_threads_.load () ||
+                             self.expired.load (std::memory_order_relaxed)) &&
+                            this->try_retire (id)))
+                {
+                    this->work_available_.cancel_wait ();
+                    return false;
+                }
+
+                if (!this->park (id, key))
+                    self.expired.store (true, std::memory_order_relaxed);
+            }
+        }
+
+        /*
+         * Blocks on work_available_; returns false if a worker allowed to
+         * retire timed out instead of being notified.
+         */
+        bool park (std::size_t id, detail::eventcount::key_type key)
+        {
+#if defined(DSA_TASK_STATS) || defined(DSA_TASK_TRACE)
+            auto const start = detail::clock_ns ();
+#endif
+            auto notified = true;
+            if (id >= this->min_threads_.load () &&
+                this->idle_timeout_.count () > 0)
+                notified = this->work_available_.commit_wait_for (
+                    key, this->idle_timeout_
+                );
+            else
+                this->work_available_.commit_wait (key);
+#if defined(DSA_TASK_STATS) || defined(DSA_TASK_TRACE)
+            auto const stop = detail::clock_ns ();
+#endif
+#ifdef DSA_TASK_STATS
+            worker_counters::add (this->workers_ [id].stats.parked_ns,
+                                  stop - start);
+#endif
+#ifdef DSA_TASK_TRACE
+            this->workers_ [id].trace.record (
+                detail::trace_kind::park, nullptr, start, stop
+            );
+#endif
+            return notified;
+        }
+
+        /*
+         * Only the highest numbered live worker may retire. Tasks it leaves
+         * behind stay visible to thieves, which are woken to look for them,
+         * as is the worker below if its idle timeout has already expired, so
+         * that it can now retire in turn.
+         */
+        bool try_retire (std::size_t id)
+        {
+            auto expected = id + 1;
+            if (id < this->min_threads_.load () ||
+                !this->live_.compare_exchange_strong (expected, id))
+                return false;
+
+            if (this->queued () != 0 ||
+                (id > 0 && this->workers_ [id - 1].expired.load ()))
+                this->work_available_.notify_all ();
+            return true;
+        }
+
+        /*
+         * Starts workers until n are live; resize_mutex_ must be held.
+         */
+        void grow_to (std::size_t n)
+        {
+            n = std::min (n, this->capacity_);
+            auto live = this->live_.load ();
+            while (!this->done_.load () && live < n) {
+                if (this->started_.load () < live + 1)
+                    this->started_.store (live + 1);
+                if (this->live_.compare_exchange_strong (live, live + 1)) {
+                    this->start_worker (live);
+                    live = live + 1;
+                }
+            }
+        }
+
+        /*
+         * A previous thread in the same slot has retired, but may still be on
+         * its way out of run.
+         */
+        void start_worker (std::size_t id)
+        {
+            if (this->threads_ [id].joinable ())
+                this->threads_ [id].join ();
+            {
+                std::unique_lock <std::mutex> lock (this->idle_mutex_);
+                this->workers_ [id].exited.store (false);
+                this->workers_ [id].expired.store (false);
+            }
+            this->threads_ [id] = std::thread (&task_system::run, this, id);
+        }
+
+        /*
+         * Called on every push, so the common case of a pool at its upper
+         * bound costs two loads. Each parked worker is counted as able to
+         * take one more task; a worker just woken may still be counted as
+         * parked, which errs on the side of not growing.
+         */
+        void maybe_grow (void)
+        {
+            auto const live = this->live_.load (std::memory_order_relaxed);
+            if (live >= this->max_threads_.load (std::memory_order_relaxed) ||
+                this->queued () <=
+                    this->backlog_ * live + this->work_available_.waiters ())
+                return;
+
+            std::unique_lock <std::mutex>
+                lock (this->resize_mutex_, std::try_to_lock);
+            if (lock)
+                this->grow_to (live + 1);
+        }
+
+        /*
+         * A worker runs until done has been called and there is no queued
+         * work left anywhere; tasks still running elsewhere may push more, so
+         * it keeps looking (and, if need be, sleeping) until then.
+         */
+        void run (std::size_t id)
+        {
+            this_worker () = worker_info {
+                this, id, 0x9e3779b97f4a7c15ull * (id + 1), 0
+            };
+            if (this->cpu_of_ [id] >= 0)
+                detail::pin_this_thread (this->cpu_of_ [id]);
+
+            while (true) {
+                task t;
+                if (!this->find_work (id, t) && !this->wait_for_work (id, t))
+                    break;
+                this->invoke (id, t);
+
+                if (id >= this->max_threads_.load (std::memory_order_relaxed)
+                    && this->try_retire (id))
+                    break;
+            }
+
+            this_worker () = worker_info {nullptr, 0, 0, 0};
+            {
+                std::unique_lock <std::mutex> lock (this->idle_mutex_);
+                this->workers_ [id].exited.store (true);
+            }
+            this->idle_cv_.notify_all ();
+        }
+
+        template <class F, class ... Args>
+        task make_detached (F && f, Args && ... args)
+        {
+            return task (
+                task::detached_t {}, std::allocator_arg_t {}, this->alloc_,
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+        }
+
+        /*
+         * Counts n tasks against the queue limit if they fit under it, or if
+         * nothing is counted at all, so that a batch larger than the limit is
+         * still let through once the queues have drained. The compare and
+         * swap keeps concurrent pushes from overshooting the limit together.
+         */
+        bool reserve (std::size_t n) noexcept
+        {
+            auto const limit =
+                this->queue_limit_.load (std::memory_order_relaxed);
+            if (limit == 0) {
+                this->admitted_.fetch_add (n);
+                return true;
+            }
+
+            auto count = this->admitted_.load ();
+            do {
+                if (count != 0 && count + n > limit)
+                    return false;
+            } while (!this->admitted_.compare_exchange_weak (count,
+                                                             count + n));
+            return true;
+        }
+
+        /*
+         * Takes n tasks off the count, as they are taken from the queues or
+         * when a reserved push did not happen after all.
+         */
+        void release (std::size_t n) noexcept
+        {
+            this->admitted_.fetch_sub (n);
+            if (this->queue_limit_.load (std::memory_order_relaxed) != 0)
+                this->space_available_.notify_all ();
+        }
+
+        /*
+         * Applies the queue limit to a push of n tasks about to be made,
+         * reserving them; returns false, reserving nothing, if the caller
+         * should run the tasks itself instead. Every push goes through here.
+         * Workers are never blocked, since they are the ones that make
+         * space, and are counted over the limit instead; so is everything
+         * pushed after done.
+         */
+        bool admit (std::size_t n = 1)
+        {
+            if (this->reserve (n))
+                return true;
+            if (this->overflow_.load () == overflow::run_on_caller)
+                return false;
+
+            std::size_t id;
+            if (this->in_worker (id) || this->done_.load ()) {
+                this->admitted_.fetch_add (n);
+                return true;
+            }
+
+            while (true) {
+                auto const key = this->space_available_.prepare_wait ();
+                if (this->reserve (n)) {
+                    this->space_available_.cancel_wait ();
+                    return true;
+                } else if (this->done_.load ()) {
+                    this->space_available_.cancel_wait ();
+                    this->admitted_.fetch_add (n);
+                    return true;
+                }
+                this->space_available_.commit_wait (key);
+            }
+        }
+
+        /*
+         * Marks t as pushed now, for the queue wait histogram.
+         */
+        static void stamp (task & t) noexcept
+        {
+#ifdef DSA_TASK_STATS
+            t._pushed = detail::clock_ns ();
+#else
+            (void) t;
+#endif
+        }
+
+        /*
+         * Pushes onto the queue of worker id, which must be the caller.
+         */
+        void push_local (std::size_t id, std::size_t lane, task && t)
+        {
+            stamp (t);
+            this->outstanding_++;
+            this->queued_ [lane]++;
+            this->queue (id, lane).push_local (std::move (t));
+            this->work_available_.notify_one ();
+            this->maybe_grow ();
+        }
+
+        /*
+         * Pushes onto the caller's own queue from a worker, and onto the
+         * shared queues from any other thread.
+         */
+        void enqueue (std::size_t lane, task && t)
+        {
+            std::size_t id;
+            if (this->in_worker (id))
+                this->push_local (id, lane, std::move (t));
+            else
+                this->push_shared (lane, std::move (t));
+        }
+
+        /*
+         * Round-robin over the queues of a lane, starting from the next
+         * index; each queue is tried without blocking before falling back to
+         * a blocking push onto the first.
+         */
+        void push_shared (std::size_t lane, task && t)
+        {
+            this->push_among (
+                lane, std::move (t),
+                std::max <std::size_t> (1, this->live_.load ()),
+                [] (std::size_t k) { return k; }
+            );
+        }
+
+        /*
+         * As push_shared, over the workers of one node only.
+         */
+        void push_to_node (std::size_t node, std::size_t lane, task && t)
+        {
+            if (!this->admit ()) {
+                this->call (t);
+                return;
+            }
+
+            auto const & workers =
+                this->node_workers_ [node % this->node_workers_.size ()];
+
+            /* workers are listed in order, so the live ones come first */
+            auto const live = static_cast <std::size_t> (std::distance (
+                workers.begin (),
+                std::lower_bound (
+                    workers.begin (), workers.end (), this->live_.load ()
+                )
+            ));
+            if (live == 0)
+                this->push_shared (lane, std::move (t));
+            else
+                this->push_among (
+                    lane, std::move (t), live,
+                    [&workers] (std::size_t k) { return workers [k]; }
+                );
+        }
+
+        /*
+         * Round-robin over the queues of workers worker (0) to worker (n - 1).
+         */
+        template <class Worker>
+        void push_among (std::size_t lane, task && t, std::size_t n,
+                         Worker && worker)
+        {
+            stamp (t);
+            this->outstanding_++;
+            auto const idx =
+                this->current_index_.fetch_add (1, std::memory_order_relaxed);
+            for (std::size_t k = 0; k < 10 * n; ++k) {
+                /*
+                 * In order to maintain consistency we need to speculatively
+                 * incremement the queued count and then decrement only if
+                 * the try_push call failed. This is because the queued count
+                 * must be incremented before a push and decremented only after
+                 * a pop.
+                 */
+                this->queued_ [lane]++;
+                if (this->queue (worker ((idx + k) % n), lane).try_push (t)) {
+                    this->work_available_.notify_one ();
+                    this->maybe_grow ();
+                    return;
+                } else {
+                    this->queued_ [lane]--;
+                }
+            }
+
+            this->queued_ [lane]++;
+            this->queue (worker (idx % n), lane).push (std::move (t));
+            this->work_available_.notify_one ();
+            this->maybe_grow ();
+        }
+
+        /*
+         * Whether the calling worker's queue has run dry, so that thieves
+         * would find nothing there; always true off the pool.
+         */
+        bool local_empty (void)
+        {
+            std::size_t id;
+            return !this->in_worker (id) ||
+                this->queue (id, lane_of (priority::normal)).empty ();
+        }
+
+        /*
+         * From a worker, runs one task from its own queue or, failing that,
+         * one stolen from another; returns whether a task was run. Off the
+         * pool this never runs anything.
+         */
+        bool run_one (void)
+        {
+            std::size_t id;
+            if (!this->in_worker (id))
+                return false;
+
+            task t;
+            if (!this->find_work (id, t))
+                return false;
+
+            this->invoke (id, t);
+            return true;
+        }
+
+        void push_chunked (std::vector <task> & tasks)
+        {
+            auto const lane = lane_of (priority::normal);
+            auto const n = tasks.size ();
+            if (n == 0)
+                return;
+            if (!this->admit (n)) {
+                for (auto & t : tasks)
+                    this->call (t);
+                return;
+            }
+            for (auto & t : tasks)
+                stamp (t);
+
+            auto const live = std::max <std::size_t> (1, this->live_.load ());
+            auto const chunk = (n + live - 1) / live;
+            auto const nchunks = (n + chunk - 1) / chunk;
+            auto const idx = this->current_index_.fetch_add (
+                nchunks, std::memory_order_relaxed
+            );
+
+            this->outstanding_ += n;
+            this->queued_ [lane] += n;
+            for (std::size_t k = 0; k < nchunks; ++k) {
+                auto const first = tasks.data () + k * chunk;
+                auto const last = tasks.data () + std::min (n, (k + 1) * chunk);
+                this->queue ((idx + k) % live, lane).push_bulk (first, last);
+                this->work_available_.notify_one ();
+            }
+            this->maybe_grow ();
+        }
+
+        void join (void)
+        {
+            this->done ();
+            std::unique_lock <std::mutex> lock (this->resize_mutex_);
+            for (auto & th : this->threads_)
+                if (th.joinable ())
+                    th.join ();
+        }
+
+    public:
+        task_system (void)
+            : task_system (std::thread::hardware_concurrency ())
+        {}
+
+        /*
+         * A pool of a fixed nthreads workers. The idle policy sets how long
+         * out of work workers spin before they park, and the placement
+         * whether they are pinned to CPUs by NUMA node; see idle_policy and
+         * placement.
+         */
+        task_system (std::size_t nthreads,
+                           Allocator const & alloc = Allocator (),
+                           idle_policy idle = idle_policy {},
+                           placement place = placement::none)
+            : task_system (resize_policy {nthreads, nthreads}, alloc, idle,
+                           place)
+        {}
+
+        /*
+         * A pool that grows and shrinks within the given bounds; see
+         * resize_policy.
+         */
+        task_system (resize_policy bounds,
+                           Allocator const & alloc = Allocator (),
+                           idle_policy idle = idle_policy {},
+                           placement place = placement::none)
+            : queues_       {}
+            , threads_      (std::max <std::size_t> (1, bounds.max_threads))
+            , alloc_        (alloc)
+            , capacity_     {threads_.size ()}
+            , min_threads_  {std::max <std::size_t> (1, std::min (
+                                bounds.min_threads, threads_.size ()
+                             ))}
+            , max_threads_  {threads_.size ()}
+            , idle_timeout_ {bounds.idle_timeout}
+            , backlog_      {bounds.backlog}
+            , idle_         {idle}
+            , handler_      {}
+            , workers_      (threads_.size ())
+#ifdef DSA_TASK_TRACE
+            , trace_epoch_  {detail::clock_ns ()}
+#endif
+        {
+            this->queues_.reserve (this->capacity_ * priority_lanes);
+            for (std::size_t q = 0; q < this->capacity_ * priority_lanes; ++q)
+                this->queues_.emplace_back ();
+
+            this->place_workers (place);
+
+            std::unique_lock <std::mutex> lock (this->resize_mutex_);
+            this->grow_to (this->min_threads_.load ());
+        }
+
+        task_system (std::size_t nthreads, idle_policy idle,
+                     placement place = placement::none)
+            : task_system (nthreads, Allocator (), idle, place)
+        {}
+
+        task_system (std::size_t nthreads, placement place)
+            : task_system (nthreads, Allocator (), idle_policy {}, place)
+        {}
+
+        ~task_system (void)
+        {
+            this->join ();
+        }
+
+        void done (void)
+        {
+            this->done_.store (true);
+            this->work_available_.notify_all ();
+            this->space_available_.notify_all ();
+        }
+
+        /*
+         * Blocks, without spinning, until every task pushed so far (and every
+         * task those push in turn) has finished running. The pool stays up,
+         * so that it may be reused for another batch of work afterwards. Must
+         * not be called from one of the pool's own workers, whose current
+         * task could never finish.
+         */
+        void wait_idle (void)
+        {
+            std::size_t id;
+            if (this->in_worker (id))
+                throw std::logic_error ("wait_idle called from a worker");
+
+            this->wait_until ([this] (void) {
+                return this->outstanding_.load () == 0;
+            });
+        }
+
+        /*
+         * As wait_idle; in addition, once done has been called, waits for
+         * every worker to exit.
+         */
+        void wait_to_completion (void)
+        {
+            std::size_t id;
+            if (this->in_worker (id))
+                throw std::logic_error (
+                    "wait_to_completion called from a worker"
+                );
+
+            this->wait_until ([this] (void) {
+                return this->outstanding_.load () == 0 &&
+                    (!this->done_.load () || this->all_exited ());
+            });
+        }
+
+        void reset (void)
+        {
+            this->join ();
+            this->queues_.clear ();
+            for (auto & q : this->queued_)
+                q.store (0);
+            this->admitted_.store (0);
+            this->outstanding_.store (0);
+            this->done_.store (false);
+            this->live_.store (0);
+            this->started_.store (0);
+
+            for (std::size_t q = 0; q < this->capacity_ * priority_lanes; ++q)
+                this->queues_.emplace_back ();
+
+            std::unique_lock <std::mutex> lock (this->resize_mutex_);
+            this->grow_to (this->min_threads_.load ());
+        }
+
+        /*
+         * The number of workers currently running, and the most there can
+         * ever be.
+         */
+        std::size_t size (void) const noexcept
+        {
+            return this->live_.load ();
+        }
+
+        std::size_t capacity (void) const noexcept
+        {
+            return this->capacity_;
+        }
+
+        /*
+         * Changes the bounds of resize_policy online, clamped to [1,
+         * capacity ()]. Workers are started at once to bring the pool up to
+         * min_threads; workers above max_threads retire as soon as they
+         * finish their current task.
+         */
+        void set_bounds (std::size_t min_threads, std::size_t max_threads)
+        {
+            max_threads = std::max <std::size_t> (
+                1, std::min (max_threads, this->capacity_)
+            );
+            min_threads = std::max <std::size_t> (
+                1, std::min (min_threads, max_threads)
+            );
+
+            {
+                std::unique_lock <std::mutex> lock (this->resize_mutex_);
+                this->min_threads_.store (min_threads);
+                this->max_threads_.store (max_threads);
+                this->grow_to (min_threads);
+            }
+            this->work_available_.notify_all ();
+        }
+
+        /*
+         * Sets the pool to exactly n workers; as set_bounds (n, n).
+         */
+        void resize (std::size_t n)
+        {
+            this->set_bounds (n, n);
+        }
+
+        template <class F, class ... Args>
+        auto push (F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            return this->push (
+                priority::normal,
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+        }
+
+        /*
+         * As above, queueing the task in the lane of the given priority.
+         */
+        template <class F, class ... Args>
+        auto push (priority prio, F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            auto t = make_task (
+                std::allocator_arg_t {}, this->alloc_,
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+
+            this->push (prio, std::move (t.first));
+            return std::move (t.second);
+        }
+
+        void push (task && t)
+        {
+            this->push (priority::normal, std::move (t));
+        }
+
+        /*
+         * Called from one of the pool's workers (that is, from a running
+         * task), the task goes onto that worker's own queue, keeping parent
+         * and child on the same core until an idle worker steals it; from any
+         * other thread, tasks are spread round-robin over the workers.
+         */
+        void push (priority prio, task && t)
+        {
+            if (this->admit ())
+                this->enqueue (lane_of (prio), std::move (t));
+            else
+                this->call (t);
+        }
+
+        /*
+         * As push, but rather than blocking or running the task on the
+         * calling thread when the queue limit is reached, returns an invalid
+         * future without submitting anything. The task is reserved against
+         * the limit before it is made, so that try_submit never takes the
+         * queues over the limit, even from a worker.
+         */
+        template <class F, class ... Args>
+        auto try_submit (F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            return this->try_submit (
+                priority::normal,
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+        }
+
+        template <class F, class ... Args>
+        auto try_submit (priority prio, F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            if (!this->reserve (1))
+                return {};
+
+            try {
+                auto t = make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                );
+                this->enqueue (lane_of (prio), std::move (t.first));
+                return std::move (t.second);
+            } catch (...) {
+                this->release (1);
+                throw;
+            }
+        }
+
+        /*
+         * Bounds the number of tasks queued but not yet started, over all
+         * workers and lanes; 0, the default, is unbounded. Every push,
+         * including those of push_bulk, post, continuations, and the tasks of
+         * parallel_for, parallel_reduce and task_group, reserves its tasks
+         * against the limit with a compare and swap before queueing them, so
+         * concurrent pushes do not overshoot it together. Once it is reached,
+         * further pushes are handled as given by mode, with two exemptions:
+         * pushes from the pool's own workers are never blocked, and are
+         * counted over the limit instead, and a push_bulk batch larger than
+         * the limit is let through whole once nothing else is queued.
+         */
+        void set_queue_limit (std::size_t limit,
+                              overflow mode = overflow::block)
+        {
+            this->overflow_.store (mode);
+            this->queue_limit_.store (limit);
+            this->space_available_.notify_all ();
+        }
+
+        /*
+         * Fire-and-forget submission; the callable is run with its arguments
+         * but no promise, future, or shared state is created, and its result
+         * is discarded. Exceptions it throws are passed to the exception
+         * handler.
+         */
+        template <class F, class ... Args>
+        auto post (F && f, Args && ... args)
+            -> typename std::enable_if <!detail::is_push_option <
+                typename std::decay <F>::type
+            >::value>::type
+        {
+            this->push (this->make_detached (
+                std::forward <F> (f), std::forward <Args> (args)...
+            ));
+        }
+
+        template <class F, class ... Args>
+        auto post (priority prio, F && f, Args && ... args)
+            -> typename std::enable_if <!detail::is_push_option <
+                typename std::decay <F>::type
+            >::value>::type
+        {
+            this->push (prio, this->make_detached (
+                std::forward <F> (f), std::forward <Args> (args)...
+            ));
+        }
+
+        /*
+         * Pushes onto the workers of the given NUMA node, in the normal lane,
+         * even when called from a worker on another node. Without
+         * placement::numa there is only node 0.
+         */
+        template <class F, class ... Args>
+        auto push (numa_node node, F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            auto t = make_task (
+                std::allocator_arg_t {}, this->alloc_,
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+
+            this->push_to_node (
+                node.index, lane_of (priority::normal), std::move (t.first)
+            );
+            return std::move (t.second);
+        }
+
+        template <class F, class ... Args>
+        void post (numa_node node, F && f, Args && ... args)
+        {
+            this->push_to_node (
+                node.index, lane_of (priority::normal), this->make_detached (
+                    std::forward <F> (f), std::forward <Args> (args)...
+                )
+            );
+        }
+
+        /*
+         * Pushes a task that is dropped rather than run if its cancellation
+         * is requested before a worker gets to it; see cancellation. The
+         * token is checked as a worker takes the task from a queue, by pop
+         * or by steal, so a dropped task is never dispatched and does not
+         * count as executed; once the task has started, it runs to
+         * completion. A token or a deadline may be passed directly as the
+         * cancellation.
+         */
+        template <class F, class ... Args>
+        auto push (cancellation c, F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            return this->push (
+                priority::normal, std::move (c),
+                std::forward <F> (f), std::forward <Args> (args)...
+            );
+        }
+
+        /*
+         * As above, queueing the task in the lane of the given priority.
+         */
+        template <class F, class ... Args>
+        auto push (priority prio, cancellation c, F && f, Args && ... args)
+            -> typename std::remove_reference <
+                decltype (make_task (
+                    std::allocator_arg_t {}, this->alloc_,
+                    std::forward <F> (f), std::forward <Args> (args)...
+                ).second)
+            >::type
+        {
+            using wrapper = detail::cancellable <
+                typename std::decay <F>::type, false
+            >;
+
+            auto t = make_task (
+                std::allocator_arg_t {}, this->alloc_,
+                wrapper (std::move (c), &this->dropped_, std::forward <F> (f)),
+                std::forward <Args> (args)...
+            );
+
+            this->push (prio, std::move (t.first));
+            return std::move (t.second);
+        }
+
+        template <class F, class ... Args>
+        void post (cancellation c, F && f, Args && ... args)
+        {
+            this->post (priority::normal, std::move (c),
+                        std::forward <F> (f), std::forward <Args> (args)...);
+        }
+
+        template <class F, class ... Args>
+        void post (priority prio, cancellation c, F && f, Args && ... args)
+        {
+            using wrapper = detail::cancellable <
+                typename std::decay <F>::type, true
+            >;
+
+            this->push (prio, this->make_detached (
+                wrapper (std::move (c), &this->dropped_, std::forward <F> (f)),
+                std::forward <Args> (args)...
+            ));
+        }
+
+        /*
+         * The number of tasks dropped by their cancellation so far.
+         */
+        std::uint64_t dropped (void) const noexcept
+        {
+            return this->dropped_.load (std::memory_order_relaxed);
+        }
+
+        /*
+         * The number of NUMA nodes workers were placed on, and the node of
+         * each worker.
+         */
+        std::size_t numa_nodes (void) const noexcept
+        {
+            return this->node_workers_.size ();
+        }
+
+        std::size_t node_of_worker (std::size_t id) const
+        {
+            return this->node_of_.at (id);
+        }
+
+        /*
+         * Submits each callable in [first, last) as a task, returning the
+         * futures in the same order. Elements are copied (or moved, given move
+         * iterators) into their tasks. Rather than pushing each task in turn,
+         * the batch is split into one contiguous chunk per worker, and each
+         * chunk is enqueued with a single lock acquisition and wakeup; the
+         * queued count is updated once for the whole batch. Unlike push, a
+         * batch is spread over all workers even when submitted from one.
+         */
+        template <class InputIt>
+        auto push_bulk (InputIt first, InputIt last)
+            -> std::vector <std::future <detail::task_result_t <
+                typename std::iterator_traits <InputIt>::value_type
+            >>>
+        {
+            std::vector <std::future <detail::task_result_t <
+                typename std::iterator_traits <InputIt>::value_type
+            >>> futures;
+            std::vector <task> tasks;
+
+            for (; first != last; ++first) {
+                auto t = make_task (
+                    std::allocator_arg_t {}, this->alloc_, *first
+                );
+                tasks.emplace_back (std::move (t.first));
+                futures.emplace_back (std::move (t.second));
+            }
+
+            this->push_chunked (tasks);
+            return futures;
+        }
+
+        /*
+         * As above, but submits f (*it) for each it in [first, last); f is
+         * copied into every task.
+         */
+        template <class F, class InputIt>
+        auto push_bulk (F && f, InputIt first, InputIt last)
+            -> std::vector <std::future <detail::task_result_t <
+                F, typename std::iterator_traits <InputIt>::value_type
+            >>>
+        {
+            std::vector <std::future <detail::task_result_t <
+                F, typename std::iterator_traits <InputIt>::value_type
+            >>> futures;
+            std::vector <task> tasks;
+
+            for (; first != last; ++first) {
+                auto t = make_task (
+                    std::allocator_arg_t {}, this->alloc_, f, *first
+                );
+                tasks.emplace_back (std::move (t.first));
+                futures.emplace_back (std::move (t.second));
+            }
+
+            this->push_chunked (tasks);
+            return futures;
+        }
+
+        /*
+         * Sets the handler invoked, on the worker thread, with any exception
+         * escaping a task submitted with post. The handler must not throw.
+         */
+        void set_exception_handler (exception_handler h)
+        {
+            std::unique_lock <std::mutex> lock (this->handler_mutex_);
+            this->handler_ = std::move (h);
+        }
+
+#ifdef DSA_TASK_COROUTINES
+        /*
+         * co_await system.schedule () suspends the calling coroutine and
+         * resumes it on one of this system's workers; from a worker, it goes
+         * through that worker's own queue like push.
+         */
+        detail::schedule_awaiter <task_system> schedule (void) noexcept
+        {
+            return detail::schedule_awaiter <task_system> {*this};
+        }
+#endif
+
+        /*
+         * Selects how idle workers steal; steal_mode::half by default. May
+         * be changed at any time.
+         */
+        void set_steal_mode (steal_mode m) noexcept
+        {
+            this->steal_mode_.store (m, std::memory_order_relaxed);
+        }
+
+        /*
+         * A snapshot of the steal counters; each counter is read atomically,
+         * but the set as a whole may be torn while workers are stealing.
+         */
+        steal_stats steal_statistics (void) const noexcept
+        {
+            steal_stats s {0, 0, 0, 0};
+            for (auto const & w : this->workers_) {
+                auto const & c = w.steals;
+                s.successes += c.successes.load (std::memory_order_relaxed);
+                s.attempts  += c.attempts.load (std::memory_order_relaxed);
+                s.tasks     += c.tasks.load (std::memory_order_relaxed);
+            }
+            s.failures = s.attempts > s.successes ?
+                s.attempts - s.successes : 0;
+            return s;
+        }
+
+#ifdef DSA_TASK_STATS
+        /*
+         * A snapshot of the per-worker statistics, one entry per worker slot
+         * up to capacity (), whether or not that worker is running. As for
+         * steal_statistics, each counter is read atomically but the whole
+         * may be torn; the hot path takes no lock for it.
+         */
+        scheduler_stats statistics (void) const
+        {
+            scheduler_stats s {};
+            s.workers.resize (this->capacity_);
+            for (std::size_t id = 0; id < this->capacity_; ++id) {
+                auto const & c = this->workers_ [id].stats;
+                auto const & sc = this->workers_ [id].steals;
+                auto & w = s.workers [id];
+
+                auto const attempts =
+                    sc.attempts.load (std::memory_order_relaxed);
+                w.executed   = c.executed.load (std::memory_order_relaxed);
+                w.steals     = sc.successes.load (std::memory_order_relaxed);
+                w.failed_steals = attempts > w.steals ? attempts - w.steals : 0;
+                w.parked_ns  = c.parked_ns.load (std::memory_order_relaxed);
+                w.running_ns = c.running_ns.load (std::memory_order_relaxed);
+                worker_counters::read (c.queue_wait, w.queue_wait);
+                worker_counters::read (c.run_time, w.run_time);
+                s.total += w;
+            }
+            return s;
+        }
+#endif
+
+#ifdef DSA_TASK_TRACE
+        /*
+         * Writes the events still held in every worker's trace buffer as a
+         * Chrome trace (the JSON format read by chrome://tracing and by
+         * Perfetto), one track per worker slot, with times relative to the
+         * construction of the task_system. Tasks are named as given with
+         * dsa::label, or "task". This may be called while workers are
+         * running; events recorded meanwhile may or may not be included.
+         */
+        void write_trace (std::ostream & out) const
+        {
+            out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+            auto first = true;
+            std::vector <detail::trace_record> records;
+            for (std::size_t id = 0; id < this->capacity_; ++id) {
+                out << (first ? "" : ",")
+                    << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                    << "\"pid\":1,\"tid\":" << id
+                    << ",\"args\":{\"name\":\"worker " << id << "\"}}";
+                first = false;
+
+                records.clear ();
+                this->workers_ [id].trace.copy_to (records);
+                for (auto const & r : records) {
+                    auto const begin =
+                        r.begin > this->trace_epoch_ ?
+                            r.begin - this->trace_epoch_ : 0;
+
+                    out << ",\n{\"name\":";
+                    switch (r.kind) {
+                    case detail::trace_kind::run:
+                        detail::write_json_string (
+                            out, r.name ? r.name : "task"
+                        );
+                        out << ",\"cat\":\"task\",\"ph\":\"X\"";
+                        break;
+                    case detail::trace_kind::park:
+                        out << "\"park\",\"cat\":\"idle\",\"ph\":\"X\"";
+                        break;
+                    case detail::trace_kind::steal:
+                    default:
+                        out << "\"steal\",\"cat\":\"steal\",\"ph\":\"i\","
+                            << "\"s\":\"t\",\"args\":{\"victim\":"
+                            << r.arg << "}";
+                        break;
+                    }
+
+                    out << ",\"pid\":1,\"tid\":" << id << ",\"ts\":";
+                    detail::write_micros (out, begin);
+                    if (r.kind != detail::trace_kind::steal) {
+                        out << ",\"dur\":";
+                        detail::write_micros (out, r.end - r.begin);
+                    }
+                    out << "}";
+                }
+            }
+            out << "\n]}\n";
+        }
+#endif
+    };
+namespace detail
+{
+    /*
+     * task_system_access; the hooks into task_system internals used by the
+     * algorithms built on top of it (see parallel.hpp).
+     */
+    template <class System>
+    struct task_system_access
+    {
+        static std::size_t concurrency (System const & s) noexcept
+        {
+            return s.live_.load ();
+        }
+
+        static bool in_worker (System const & s) noexcept
+        {
+            std::size_t id;
+            return s.in_worker (id);
+        }
+
+        /*
+         * Spreads tasks over the workers even when called from one.
+         */
+        template <class F>
+        static void spawn (System & s, F && f)
+        {
+            auto t = s.make_detached (std::forward <F> (f));
+            if (s.admit ())
+                s.push_shared (System::lane_of (priority::normal),
+                               std::move (t));
+            else
+                s.call (t);
+        }
+
+        template <class F>
+        static void spawn_local (System & s, F && f)
+        {
+            s.push (s.make_detached (std::forward <F> (f)));
+        }
+
+        static bool local_empty (System & s)
+        {
+            return s.local_empty ();
+        }
+
+        static bool run_one (System & s)
+        {
+            return s.run_one ();
+        }
+
+        static std::size_t queued (System const & s) noexcept
+        {
+            return s.queued ();
+        }
+
+        static eventcount & work_available (System & s) noexcept
+        {
+            return s.work_available_;
+        }
+    };
+
+    /*
+     * task_access; builds detached tasks (as used by task_system::post)
+     * outside of a task_system, for the continuations of future.hpp.
+     */
+    struct task_access
+    {
+        template <class F>
+        static task make_detached (F && f)
+        {
+            return task (
+                task::detached_t {}, std::allocator_arg_t {},
+                pool_allocator <task> {}, std::forward <F> (f)
+            );
         }
     };
+}   // namespace detail
 }   // namespace dsa
 
 #endif  // #ifndef DSA_TASK_HPP